@@ -24,6 +24,9 @@
  * IN THE SOFTWARE.
  */
 
+/* The library itself always provides every level. */
+#undef LOG_COMPILE_MIN_LEVEL
+
 #include "sir.h"
 #include "sirdefaults.h"
 #include "sirfilecache.h"
@@ -41,7 +44,7 @@ log_stdoutlevels(log_levels levels)
 {
   _log_defaultlevels(&levels, log_stdout_def_lvls);
   log_update_data data = {
-    &levels, NULL
+    &levels, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
   };
 
   return _log_writeinit(&data, _log_stdoutlevels);
@@ -52,7 +55,7 @@ log_stdoutopts(log_options opts)
 {
   _log_defaultopts(&opts, log_stdout_def_opts);
   log_update_data data = {
-    NULL, &opts
+    NULL, &opts, NULL, NULL, NULL, NULL, NULL, NULL, NULL
   };
 
   return _log_writeinit(&data, _log_stdoutopts);
@@ -63,7 +66,7 @@ log_stderrlevels(log_levels levels)
 {
   _log_defaultlevels(&levels, log_stderr_def_lvls);
   log_update_data data = {
-    &levels, NULL
+    &levels, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
   };
 
   return _log_writeinit(&data, _log_stderrlevels);
@@ -74,7 +77,7 @@ log_stderropts(log_options opts)
 {
   _log_defaultopts(&opts, log_stderr_def_opts);
   log_update_data data = {
-    NULL, &opts
+    NULL, &opts, NULL, NULL, NULL, NULL, NULL, NULL, NULL
   };
 
   return _log_writeinit(&data, _log_stderropts);
@@ -86,7 +89,7 @@ log_sysloglevels(log_levels levels)
 #ifndef LOG_NO_SYSLOG
   _log_defaultlevels(&levels, log_syslog_def_lvls);
   log_update_data data = {
-    &levels, NULL
+    &levels, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
   };
   return _log_writeinit(&data, _log_sysloglevels);
 #else /* ifndef LOG_NO_SYSLOG */
@@ -99,7 +102,7 @@ log_filelevels(logfileid_t id, log_levels levels)
 {
   _log_defaultlevels(&levels, log_file_def_lvls);
   log_update_data data = {
-    &levels, NULL
+    &levels, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
   };
 
   return _log_updatefile(id, &data);
@@ -110,12 +113,105 @@ log_fileopts(logfileid_t id, log_options opts)
 {
   _log_defaultopts(&opts, log_file_def_opts);
   log_update_data data = {
-    NULL, &opts
+    NULL, &opts, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+  };
+
+  return _log_updatefile(id, &data);
+}
+
+bool
+log_fileflush(logfileid_t id, uint32_t count, uint32_t msec,
+              log_levels levels)
+{
+  logflush flush = {
+    count, msec, levels
+  };
+  log_update_data data = {
+    NULL, NULL, &flush, NULL, NULL, NULL, NULL, NULL, NULL
+  };
+
+  return _log_validlevels(levels) && _log_updatefile(id, &data);
+}
+
+bool
+log_fileroll(logfileid_t id, uint64_t size, uint32_t interval)
+{
+  logroll roll = {
+    size, interval
+  };
+  log_update_data data = {
+    NULL, NULL, NULL, NULL, &roll, NULL, NULL, NULL, NULL
+  };
+
+  return _log_updatefile(id, &data);
+}
+
+bool
+log_filecompress(logfileid_t id, bool compress)
+{
+  log_update_data data = {
+    NULL, NULL, NULL, NULL, NULL, &compress, NULL, NULL, NULL
+  };
+
+  return _log_updatefile(id, &data);
+}
+
+bool
+log_fileretain(logfileid_t id, uint32_t count, uint64_t bytes, uint32_t age)
+{
+  logretain retain = {
+    count, bytes, age
+  };
+  log_update_data data = {
+    NULL, NULL, NULL, NULL, NULL, NULL, &retain, NULL, NULL
   };
 
   return _log_updatefile(id, &data);
 }
 
+bool
+log_filepreallocate(logfileid_t id, bool prealloc)
+{
+  log_update_data data = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &prealloc
+  };
+
+  return _log_updatefile(id, &data);
+}
+
+bool
+log_filebackend(logfileid_t id, log_backend backend, size_t bufsize)
+{
+  logwriter writer = {
+    backend, bufsize
+  };
+  log_update_data data = {
+    NULL, NULL, NULL, &writer, NULL, NULL, NULL, NULL, NULL
+  };
+
+  return _log_validwriter(&writer) && _log_updatefile(id, &data);
+}
+
+bool
+log_filesync(logfileid_t id, log_level level)
+{
+  /* The level and every more severe one (lower values). */
+  log_levels levels = LOGL_NONE == level ? LOGL_NONE
+                                         : (log_levels)( ( level << 1 ) - 1 );
+  log_update_data data = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, &levels, NULL
+  };
+
+  return ( LOGL_NONE == level || _log_validlevel(level) )
+         && _log_updatefile(id, &data);
+}
+
+bool
+log_flush(void)
+{
+  return _log_flush();
+}
+
 bool
 log_cleanup(void)
 {
@@ -224,3 +320,9 @@ log_resettextstyles(void)
 {
   return _log_resettextstyles();
 }
+
+bool
+log_setthreadname(const logchar_t *name)
+{
+  return _log_setthreadname(name);
+}
@@ -178,6 +178,201 @@ bool log_filelevels(logfileid_t id, log_levels levels);
 
 bool log_fileopts(logfileid_t id, log_options opts);
 
+/*
+ * Sets when output to a log file is written out of libsir's buffers.
+ *
+ * Buffered output is written when any of the following is true:
+ *
+ * count  = This many messages are buffered (0 = no limit). The default
+ *          is 1: messages are written to the file immediately, without
+ *          buffering, and msec and levels are ignored.
+ * msec   = The oldest buffered message is this many milliseconds old
+ *          (0 = no limit).
+ * levels = A message with any of these log_level was just buffered
+ *          (e.g. LOGL_ERROR | LOGL_CRIT | LOGL_ALERT | LOGL_EMERG).
+ *
+ * With count and msec both 0 and no levels, buffered output is only
+ * written when the buffer is full, by log_flush, or when the file is
+ * rolled, removed or closed.
+ *
+ * retval true  = The policy was updated successfully.
+ * retval false = An error occurred while trying to update the policy.
+ */
+
+bool log_fileflush(logfileid_t id, uint32_t count, uint32_t msec,
+                   log_levels levels);
+
+/*
+ * Sets when a log file is rolled: renamed to an archive (with the time and
+ * a sequence number added to its name), and replaced with a new file.
+ *
+ * size     = The file is rolled once it's this many bytes (0 = no limit).
+ *            The default is LOG_FROLLSIZE.
+ * interval = The file is rolled at each multiple of this many seconds
+ *            since the epoch (0 = no interval; the default). For example,
+ *            3600 rolls on the hour, and 86400 at midnight (UTC).
+ *
+ * Files are rolled as they're written to, so a file that isn't written to
+ * over an interval isn't rolled until it is.
+ *
+ * The thread that rolls a file only opens its replacement, under a temporary
+ * name (LOG_FROLLTMPFORMAT); a background thread then archives the file and
+ * gives the replacement the file's name. Until it does, output goes to the
+ * replacement under its temporary name. If LOG_ROLLQUEUE files are waiting
+ * to be archived, files are rolled once there's room. log_flush waits for
+ * files to be archived. Where threads aren't available (LOG_NO_ASYNC), the
+ * thread that rolls the file archives it.
+ *
+ * retval true  = The policy was updated successfully.
+ * retval false = An error occurred while trying to update the policy.
+ */
+
+bool log_fileroll(logfileid_t id, uint64_t size, uint32_t interval);
+
+/*
+ * Sets whether a log file's archives are compressed.
+ *
+ * Each time the file is rolled, the archive is handed to a background
+ * thread, which compresses it in the LZ4 frame format (see lz4(1)) to a
+ * file of the same name with LOG_FCOMPRESSEXT appended, then removes the
+ * original. The thread that rolled the file doesn't wait. log_cleanup
+ * waits for those waiting to be compressed.
+ *
+ * Where threads aren't available (LOG_NO_ASYNC), archives are compressed
+ * by the thread that rolled the file.
+ *
+ * retval true  = The setting was updated successfully.
+ * retval false = An error occurred while trying to update the setting.
+ */
+
+bool log_filecompress(logfileid_t id, bool compress);
+
+/*
+ * Sets whether the disk space for a log file is allocated in advance.
+ *
+ * Whenever the file is opened (or rolled), and when its roll size changes,
+ * the space up to the roll size (see log_fileroll) is allocated at once,
+ * without changing the file's size, so that each write that extends the
+ * file doesn't have to allocate blocks (with fallocate and
+ * FALLOC_FL_KEEP_SIZE). What's left over is released when the file is
+ * rolled or closed. Files without a roll size, LOGB_MMAP files (which are
+ * preallocated anyway) and LOGB_DIRECT files (which are truncated whenever
+ * they're flushed) aren't affected.
+ *
+ * Only available on Linux; elsewhere, the setting is ignored.
+ *
+ * retval true  = The setting was updated successfully.
+ * retval false = An error occurred while trying to update the setting.
+ */
+
+bool log_filepreallocate(logfileid_t id, bool prealloc);
+
+/*
+ * Sets how many of a log file's archives are kept. Once there are more,
+ * the oldest are removed until none of the following is true:
+ *
+ * count = There are more than this many archives (0 = no limit).
+ * bytes = They add up to more than this many bytes (0 = no limit).
+ * age   = The oldest was last written to more than this many seconds ago
+ *         (0 = no limit).
+ *
+ * Archives are those with names made from the file's name (see
+ * LOG_FNAMEFORMAT), including compressed archives (log_filecompress).
+ * When a policy is first set, the file's directory is searched for them
+ * once; after that, libsir keeps track of the archives it creates. Archives
+ * are removed by a background thread, when the policy is set and each time
+ * the file is rolled; where threads aren't available (LOG_NO_ASYNC), by the
+ * calling thread.
+ *
+ * retval true  = The policy was updated successfully.
+ * retval false = An error occurred while trying to update the policy.
+ */
+
+bool log_fileretain(logfileid_t id, uint32_t count, uint64_t bytes,
+                    uint32_t age);
+
+/*
+ * Sets how output is written to a log file.
+ *
+ * backend = LOGB_STDIO (the default) writes through a C library stream.
+ *           LOGB_FD writes to a file descriptor opened with O_APPEND and
+ *           O_CLOEXEC, buffering output in memory owned by libsir. The
+ *           buffer only ever holds whole messages and is written out in a
+ *           single write, so processes appending to the same file (e.g.
+ *           after fork) don't split each other's lines.
+ *           LOGB_MMAP preallocates the file to the roll size and maps it
+ *           into memory; messages are copied into the mapping, without
+ *           system calls, and are visible to readers of the file at once.
+ *           Until the file is rolled, removed or closed, it is padded with
+ *           zeros to the preallocated size. Don't share it with other
+ *           processes that write to it.
+ *           LOGB_URING buffers output as LOGB_FD does, but writes the buffer
+ *           through an io_uring shared by all such files, from a second
+ *           buffer, so that logging continues while it's written. Writes
+ *           for every file that wants a message are submitted together, in
+ *           a single system call, and completions are collected without
+ *           one. While a file's write is in progress, its messages are
+ *           buffered behind it (even with a flush count of 1) and written
+ *           together once it completes, by the next message or a background
+ *           thread. Where io_uring isn't available (other than on Linux 5.6
+ *           and later, or with LOG_NO_URING defined), it behaves as LOGB_FD.
+ *           LOGB_DIRECT buffers output, and writes it in whole blocks of
+ *           LOG_FDIRECTALIGN bytes, bypassing the page cache (O_DIRECT), so
+ *           that large volumes of output don't push other data out of it.
+ *           Flush policies (see log_fileflush) write whole blocks only; the
+ *           default one is replaced by a timer of LOG_FDIRECTMSEC. The last,
+ *           partial block is written padded with zeros, and the file
+ *           truncated, by log_flush, for levels set with log_filesync, and
+ *           when the file is rolled, removed or closed; it's written again
+ *           once there's more of it. Where the file system doesn't support
+ *           O_DIRECT, the page cache is used.
+ *           Don't share the file with other processes that write to it.
+ *           Only LOGB_STDIO is available on Windows.
+ * bufsize = The size of the LOGB_FD, LOGB_DIRECT (rounded up to a multiple of
+ *           LOG_FDIRECTALIGN) or each LOGB_URING buffer, in bytes
+ *           (0 = LOG_FBUFSIZE, at most LOG_FBUFMAX). Ignored otherwise.
+ *
+ * Buffered output is written according to the flush policy (see
+ * log_fileflush), whenever the buffer is full, and before fork. Messages
+ * too large for the buffer are written directly.
+ *
+ * retval true  = The backend was updated successfully.
+ * retval false = An error occurred while trying to update the backend.
+ */
+
+bool log_filebackend(logfileid_t id, log_backend backend, size_t bufsize);
+
+/*
+ * Sets which messages are on storage before the call that logs them returns
+ * (e.g. LOGL_CRIT for LOGL_CRIT, LOGL_ALERT and LOGL_EMERG).
+ *
+ * level = Messages of this level, or more severe, are written out of any
+ *         buffers (see log_fileflush) and synced with fdatasync before
+ *         returning (LOGL_NONE = none; the default).
+ *
+ * Syncs are group commits: while one thread syncs the file, other threads
+ * go on writing to it, then wait, and the next sync (by one of them) covers
+ * every message written in the meantime. The call returns false if the sync
+ * that covered its message failed. In asynchronous mode, such messages are
+ * written by the calling thread, after those already queued.
+ *
+ * retval true  = The policy was updated successfully.
+ * retval false = An error occurred while trying to update the policy.
+ */
+
+bool log_filesync(logfileid_t id, log_level level);
+
+/*
+ * Writes anything libsir has buffered: queued messages (asynchronous
+ * mode), buffered log file output, and stdout and stderr, and waits for
+ * rolled log files to be archived (see log_fileroll).
+ *
+ * retval true  = Everything was written.
+ * retval false = An error occurred.
+ */
+
+bool log_flush(void);
+
 /*
  * Frees allocated resources and resets internal state.
  *
@@ -292,4 +487,49 @@ bool log_settextstyle(log_level level, log_textstyle style);
 
 bool log_resettextstyles(void);
 
+/*
+ * Sets the name of the calling thread, as it appears in formatted output.
+ *
+ * The process and thread identifiers included in output are cached for each
+ * thread the first time it logs a message; names applied to a thread by
+ * other means after that point are not reflected in output. Use this
+ * function to name threads instead. Names longer than LOG_MAXPID - 1
+ * characters are truncated. May be called before log_init.
+ *
+ * retval true  = The name was updated successfully.
+ * retval false = An error occurred while trying to update the name.
+ */
+
+bool log_setthreadname(const logchar_t *name);
+
+/*
+ * Compile-time level elision.
+ *
+ * Define LOG_COMPILE_MIN_LEVEL to a log_level (e.g. LOGL_INFO) before
+ * including this header to turn the log_<level> functions into macros
+ * that compile to nothing for levels less severe than it: neither the
+ * call nor its argument expressions are evaluated, and the result is
+ * false. Calls for LOG_COMPILE_MIN_LEVEL and more severe levels are
+ * unaffected. The value is consulted wherever a macro is expanded.
+ */
+
+# ifdef LOG_COMPILE_MIN_LEVEL
+static inline bool
+_log_elided(bool r)
+{
+  return r; /* Keeps unused results from triggering warnings. */
+}
+
+#  define _LOG_ELIDE(level, fn, ...) \
+  _log_elided(( level ) <= ( LOG_COMPILE_MIN_LEVEL ) ? ( fn )(__VA_ARGS__) : false)
+#  define log_debug(...)  _LOG_ELIDE(LOGL_DEBUG,  log_debug,  __VA_ARGS__)
+#  define log_info(...)   _LOG_ELIDE(LOGL_INFO,   log_info,   __VA_ARGS__)
+#  define log_notice(...) _LOG_ELIDE(LOGL_NOTICE, log_notice, __VA_ARGS__)
+#  define log_warn(...)   _LOG_ELIDE(LOGL_WARN,   log_warn,   __VA_ARGS__)
+#  define log_error(...)  _LOG_ELIDE(LOGL_ERROR,  log_error,  __VA_ARGS__)
+#  define log_crit(...)   _LOG_ELIDE(LOGL_CRIT,   log_crit,   __VA_ARGS__)
+#  define log_alert(...)  _LOG_ELIDE(LOGL_ALERT,  log_alert,  __VA_ARGS__)
+#  define log_emerg(...)  _LOG_ELIDE(LOGL_EMERG,  log_emerg,  __VA_ARGS__)
+# endif /* ifdef LOG_COMPILE_MIN_LEVEL */
+
 #endif /* !_LOG_H_INCLUDED */
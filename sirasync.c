@@ -0,0 +1,374 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: bf516d8e-c99f-11f1-a477-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "sirasync.h"
+#include "sirinternal.h"
+#include "sirmutex.h"
+#include "sirthread.h"
+
+#ifndef LOG_NO_ASYNC
+
+static logqueue _log_q;
+
+/* Whether _log_async_atfork_prepare locked the queue's mutex. */
+static bool _log_q_forklocked;
+
+bool
+_log_async_start(void)
+{
+  logqueue *q = &_log_q;
+
+  if (_log_validptr(q->records))
+    {
+      return true;
+    }
+
+  q->records = (logrecord *)calloc(LOG_ASYNCQUEUE, sizeof ( logrecord ));
+
+  if (!_log_validptr(q->records))
+    {
+      _log_handleerr(errno);
+      return false;
+    }
+
+  q->mask = LOG_ASYNCQUEUE - 1;
+
+  for (size_t n = 0; n < LOG_ASYNCQUEUE; n++)
+    {
+      atomic_init(&q->records[n].seq, n);
+    }
+
+  atomic_init(&q->head,     0);
+  atomic_init(&q->tail,     0);
+  atomic_init(&q->sleeping, false);
+  atomic_init(&q->stop,     false);
+  atomic_init(&q->running,  false);
+  atomic_init(&q->producers, 0);
+
+  if (_logmutex_create(&q->mutex))
+    {
+      if (_logcond_create(&q->cond))
+        {
+          if (_logthread_create(&q->thread, _log_async_thread, q))
+            {
+              atomic_store(&q->running, true);
+              return true;
+            }
+
+          (void)_logcond_destroy(&q->cond);
+        }
+
+      (void)_logmutex_destroy(&q->mutex);
+    }
+
+  _log_safefree(q->records);
+  q->records = NULL;
+  return false;
+}
+
+bool
+_log_async_stop(void)
+{
+  logqueue *q = &_log_q;
+
+  if (!_log_validptr(q->records))
+    {
+      return true;
+    }
+
+  bool stop    = true;
+  bool running = atomic_exchange(&q->running, false);
+
+  /*
+   * Messages logged from here on are written synchronously; those already
+   * being queued are published before the writer is stopped (which it may
+   * need to be running for, if the queue is full).
+   */
+  while (0 != atomic_load(&q->producers))
+    {
+      _log_async_wake(q);
+      (void)sched_yield();
+    }
+
+  if (running)
+    {
+      atomic_store(&q->stop, true);
+      (void)_logmutex_lock(&q->mutex);
+      (void)_logcond_signal(&q->cond);
+      (void)_logmutex_unlock(&q->mutex);
+
+      stop &= _logthread_join(&q->thread);
+
+      /* Anything the writer didn't get to (none, if it exited normally). */
+      while (_log_async_dequeue(q))
+        {
+        }
+    }
+
+  stop &= _logcond_destroy(&q->cond);
+  stop &= _logmutex_destroy(&q->mutex);
+
+  _log_safefree(q->records);
+  q->records = NULL;
+
+  _log_selflog("%s: message queue stopped\n", __func__);
+  return stop;
+}
+
+bool
+_log_async_running(void)
+{
+  return atomic_load_explicit(&_log_q.running, memory_order_relaxed);
+}
+
+bool
+_log_async_enter(void)
+{
+  logqueue *q = &_log_q;
+
+  (void)atomic_fetch_add(&q->producers, 1);
+
+  /* Checked after announcing this thread, so the queue can't be freed. */
+  if (!atomic_load(&q->running))
+    {
+      (void)atomic_fetch_sub(&q->producers, 1);
+      return false;
+    }
+
+  return true;
+}
+
+void
+_log_async_leave(void)
+{
+  (void)atomic_fetch_sub(&_log_q.producers, 1);
+}
+
+bool
+_log_async_logv(const loginit *si, log_level level, const logchar_t *format,
+                va_list args)
+{
+  logqueue *q = &_log_q;
+
+  if (!_log_validptr(si) || !_log_validptr(q->records))
+    {
+      return false;
+    }
+
+  size_t pos     = atomic_load_explicit(&q->head, memory_order_relaxed);
+  logrecord *rec = NULL;
+
+  while (true)
+    {
+      rec = &q->records[pos & q->mask];
+
+      size_t seq    = atomic_load_explicit(&rec->seq, memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+      if (0 == diff)
+        {
+          if (atomic_compare_exchange_weak(&q->head, &pos, pos + 1))
+            {
+              break;
+            }
+        }
+      else if (diff < 0)
+        {
+          /* Full; wait for the writer to catch up. */
+          _log_async_wake(q);
+          (void)sched_yield();
+          pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+      else
+        {
+          pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+  logoutput output = {
+    0
+  };
+
+  rec->level = level;
+  rec->si    = *si;
+  _logbuf_mapoutput(&rec->buf, &output);
+  _log_formatfields(si, level, &output, format, args);
+  (void)memcpy(rec->len, output.len, sizeof ( rec->len ));
+  rec->skip = output.skip;
+
+  atomic_store(&rec->seq, pos + 1);
+  _log_async_wake(q);
+
+  return true;
+}
+
+bool
+_log_async_dequeue(logqueue *q)
+{
+  size_t pos     = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  logrecord *rec = &q->records[pos & q->mask];
+
+  if (atomic_load_explicit(&rec->seq, memory_order_acquire) != pos + 1)
+    {
+      return false;
+    }
+
+  /*
+   * Written where it was meant to go when it was queued, without taking
+   * the lock on the configuration (which could fail, and lose it).
+   */
+  logoutput output = {
+    0
+  };
+
+  _logbuf_mapoutput(&rec->buf, &output);
+  (void)memcpy(output.len, rec->len, sizeof ( output.len ));
+  output.skip = rec->skip;
+
+  if (!_log_dispatch(&rec->si, rec->level, &output))
+    {
+      _log_selflog("%s: failed to write queued message\n", __func__);
+    }
+
+  atomic_store_explicit(&rec->seq, pos + q->mask + 1, memory_order_release);
+  atomic_store(&q->tail, pos + 1);
+
+  return true;
+}
+
+bool
+_log_async_pending(logqueue *q)
+{
+  return atomic_load(&q->head) != atomic_load(&q->tail);
+}
+
+void
+_log_async_drain(void)
+{
+  logqueue *q = &_log_q;
+
+  if (!_log_validptr(q->records) || !_log_async_running())
+    {
+      return;
+    }
+
+  while (_log_async_pending(q))
+    {
+      _log_async_wake(q);
+      (void)sched_yield();
+    }
+}
+
+void
+_log_async_wake(logqueue *q)
+{
+  if (atomic_load(&q->sleeping))
+    {
+      (void)_logmutex_lock(&q->mutex);
+      (void)_logcond_signal(&q->cond);
+      (void)_logmutex_unlock(&q->mutex);
+    }
+}
+
+void *
+_log_async_thread(void *arg)
+{
+  logqueue *q = (logqueue *)arg;
+
+  while (true)
+    {
+      if (_log_async_dequeue(q))
+        {
+          continue;
+        }
+
+      if (_log_async_pending(q))
+        {
+          /* A message is being queued; it will be available shortly. */
+          (void)sched_yield();
+          continue;
+        }
+
+      if (atomic_load(&q->stop))
+        {
+          break;
+        }
+
+      (void)_logmutex_lock(&q->mutex);
+      atomic_store(&q->sleeping, true);
+
+      if (!_log_async_pending(q) && !atomic_load(&q->stop))
+        {
+          (void)_logcond_timedwait(&q->cond, &q->mutex, LOG_ASYNCWAIT);
+        }
+
+      atomic_store(&q->sleeping, false);
+      (void)_logmutex_unlock(&q->mutex);
+    }
+
+  return NULL;
+}
+
+void
+_log_async_atfork_prepare(void)
+{
+  logqueue *q = &_log_q;
+
+  _log_q_forklocked = atomic_load(&q->running) && _logmutex_lock(&q->mutex);
+}
+
+void
+_log_async_atfork_parent(void)
+{
+  if (_log_q_forklocked)
+    {
+      (void)_logmutex_unlock(&_log_q.mutex);
+    }
+}
+
+void
+_log_async_atfork_child(void)
+{
+  logqueue *q = &_log_q;
+
+  /*
+   * The writer thread does not exist in the child; messages logged by the
+   * child are written synchronously. Messages queued before the fork are
+   * written by the parent.
+   */
+  atomic_store(&q->running,   false);
+  atomic_store(&q->producers, 0);
+  atomic_store(&q->sleeping,  false);
+
+  if (_log_q_forklocked)
+    {
+      /* The writer may have been waiting on cond; it can't be destroyed. */
+      (void)_logmutex_unlock(&q->mutex);
+      (void)_logcond_create(&q->cond);
+    }
+}
+
+#endif /* ifndef LOG_NO_ASYNC */
@@ -0,0 +1,111 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: bf40eacc-c99f-11f1-a817-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _LOG_ASYNC_H_INCLUDED
+# define _LOG_ASYNC_H_INCLUDED
+
+# include "sirtypes.h"
+
+# ifndef LOG_NO_ASYNC
+
+/* Allocates the message queue and starts the background writer thread. */
+
+bool _log_async_start(void);
+
+/*
+ * Waits for threads queuing messages to finish, and for the background writer
+ * thread to write them; stops it, and frees the message queue. Messages
+ * logged meanwhile are written synchronously.
+ */
+
+bool _log_async_stop(void);
+
+/*
+ * Evaluates whether or not queued messages are written by a background
+ * thread in this process (false in a child process after fork).
+ */
+
+bool _log_async_running(void);
+
+/*
+ * Called before queuing messages; if it returns true, the queue remains
+ * allocated until _log_async_leave is called. If it returns false, the
+ * queue is not running (or is being stopped), and messages are written
+ * synchronously.
+ */
+
+bool _log_async_enter(void);
+
+/* Called after queuing messages, if _log_async_enter returned true. */
+
+void _log_async_leave(void);
+
+/*
+ * Formats a message and queues it for the background writer thread. Must be
+ * called between _log_async_enter and _log_async_leave.
+ */
+
+bool _log_async_logv(const loginit *si, log_level level,
+                     const logchar_t *format, va_list args);
+
+/*
+ * Writes the oldest queued message, if one is available, to the destinations
+ * configured when it was queued.
+ */
+
+bool _log_async_dequeue(logqueue *q);
+
+/* Evaluates whether or not any messages are queued (or being queued). */
+
+bool _log_async_pending(logqueue *q);
+
+/* Waits until every message queued so far has been written. */
+
+void _log_async_drain(void);
+
+/* Wakes the background writer thread if it is waiting for messages. */
+
+void _log_async_wake(logqueue *q);
+
+/* The background writer thread. */
+
+void *_log_async_thread(void *arg);
+
+/* Locks the queue before fork, if the writer is running. */
+
+void _log_async_atfork_prepare(void);
+
+/* Unlocks the queue after fork, in the parent process. */
+
+void _log_async_atfork_parent(void);
+
+/* Disables the queue in a child process after fork. */
+
+void _log_async_atfork_child(void);
+
+# endif /* ifndef LOG_NO_ASYNC */
+
+#endif /* !_LOG_ASYNC_H_INCLUDED */
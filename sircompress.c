@@ -0,0 +1,339 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 105aaefe-c9a3-11f1-afc3-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "sircompress.h"
+#include "sirinternal.h"
+
+/* Frame format constants (see the LZ4 frame format description). */
+
+#define _LOG_LZ4_MAGIC     0x184d2204U
+#define _LOG_LZ4_FLG       0x60  /* Version 01, independent blocks.   */
+#define _LOG_LZ4_BD        0x40  /* Blocks of at most 64 KiB.         */
+#define _LOG_LZ4_BLOCKSIZE ( 64 * 1024 )
+#define _LOG_LZ4_RAW       0x80000000U /* Block stored uncompressed.  */
+
+/* Block format constants. */
+
+#define _LOG_LZ4_MINMATCH  4
+#define _LOG_LZ4_LASTLITS  5  /* The last bytes are always literals.      */
+#define _LOG_LZ4_MFLIMIT   12 /* No match starts closer than this to end. */
+#define _LOG_LZ4_MAXOFFSET 65535
+#define _LOG_LZ4_HASHLOG   12
+
+static inline uint32_t
+_log_read32(const uint8_t *p)
+{
+  uint32_t v;
+  (void)memcpy(&v, p, sizeof ( v ));
+  return v;
+}
+
+static inline void
+_log_write32le(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)( v >> 8 );
+  p[2] = (uint8_t)( v >> 16 );
+  p[3] = (uint8_t)( v >> 24 );
+}
+
+static inline uint8_t *
+_log_lz4_len(uint8_t *op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    {
+      *op++ = 255;
+    }
+
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+size_t
+_log_lz4_block(const uint8_t *src, size_t len, uint8_t *dst)
+{
+  uint16_t table[1 << _LOG_LZ4_HASHLOG] = { 0 };
+  const uint8_t *ip     = src;
+  const uint8_t *anchor = src;
+  const uint8_t *end    = src + len;
+  uint8_t *op           = dst;
+
+  if (len > _LOG_LZ4_MFLIMIT)
+    {
+      const uint8_t *mflimit    = end - _LOG_LZ4_MFLIMIT;
+      const uint8_t *matchlimit = end - _LOG_LZ4_LASTLITS;
+
+      /* Positions fit in the table: blocks are at most 64 KiB. */
+      while (ip <= mflimit)
+        {
+          uint32_t seq     = _log_read32(ip);
+          uint32_t h       = ( seq * 2654435761U ) >> ( 32 - _LOG_LZ4_HASHLOG );
+          const uint8_t *r = src + table[h];
+
+          table[h] = (uint16_t)( ip - src );
+
+          if (r >= ip || ip - r > _LOG_LZ4_MAXOFFSET || _log_read32(r) != seq)
+            {
+              ip++;
+              continue;
+            }
+
+          const uint8_t *m = ip + _LOG_LZ4_MINMATCH;
+
+          while (m < matchlimit && *m == r[m - ip])
+            {
+              m++;
+            }
+
+          /* Token, literals, offset, then the match length. */
+          size_t lits    = (size_t)( ip - anchor );
+          size_t mlen    = (size_t)( m - ip ) - _LOG_LZ4_MINMATCH;
+          uint8_t *token = op++;
+          uint16_t off   = (uint16_t)( ip - r );
+
+          *token = (uint8_t)(( lits >= 15 ? 15 : lits ) << 4 );
+          if (lits >= 15)
+            {
+              op = _log_lz4_len(op, lits - 15);
+            }
+
+          (void)memcpy(op, anchor, lits);
+          op += lits;
+
+          *op++ = (uint8_t)off;
+          *op++ = (uint8_t)( off >> 8 );
+
+          *token |= (uint8_t)( mlen >= 15 ? 15 : mlen );
+          if (mlen >= 15)
+            {
+              op = _log_lz4_len(op, mlen - 15);
+            }
+
+          ip     = m;
+          anchor = ip;
+        }
+    }
+
+  size_t lits = (size_t)( end - anchor );
+
+  *op++ = (uint8_t)(( lits >= 15 ? 15 : lits ) << 4 );
+  if (lits >= 15)
+    {
+      op = _log_lz4_len(op, lits - 15);
+    }
+
+  (void)memcpy(op, anchor, lits);
+  op += lits;
+
+  return (size_t)( op - dst );
+}
+
+static inline uint32_t
+_log_rotl32(uint32_t x, int r)
+{
+  return ( x << r ) | ( x >> ( 32 - r ));
+}
+
+uint32_t
+_log_xxh32(const uint8_t *src, size_t len, uint32_t seed)
+{
+  const uint32_t p1 = 2654435761U;
+  const uint32_t p2 = 2246822519U;
+  const uint32_t p3 = 3266489917U;
+  const uint32_t p4 = 668265263U;
+  const uint32_t p5 = 374761393U;
+  const uint8_t *end = src + len;
+  uint32_t h;
+
+  if (len >= 16)
+    {
+      uint32_t v[4] = {
+        seed + p1 + p2, seed + p2, seed, seed - p1
+      };
+
+      for (; src + 16 <= end; src += 16)
+        {
+          for (int n = 0; n < 4; n++)
+            {
+              v[n] += _log_read32(src + n * 4) * p2;
+              v[n]  = _log_rotl32(v[n], 13) * p1;
+            }
+        }
+
+      h = _log_rotl32(v[0], 1) + _log_rotl32(v[1], 7)
+          + _log_rotl32(v[2], 12) + _log_rotl32(v[3], 18);
+    }
+  else
+    {
+      h = seed + p5;
+    }
+
+  h += (uint32_t)len;
+
+  for (; src + 4 <= end; src += 4)
+    {
+      h += _log_read32(src) * p3;
+      h  = _log_rotl32(h, 17) * p4;
+    }
+
+  for (; src < end; src++)
+    {
+      h += *src * p5;
+      h  = _log_rotl32(h, 11) * p1;
+    }
+
+  h ^= h >> 15;
+  h *= p2;
+  h ^= h >> 13;
+  h *= p3;
+  h ^= h >> 16;
+  return h;
+}
+
+bool
+_log_lz4_writeframe(FILE *f, FILE *z, uint8_t *in, uint8_t *out)
+{
+  uint8_t hdr[7];
+
+  _log_write32le(hdr, _LOG_LZ4_MAGIC);
+  hdr[4] = _LOG_LZ4_FLG;
+  hdr[5] = _LOG_LZ4_BD;
+  hdr[6] = (uint8_t)( _log_xxh32(hdr + 4, 2, 0) >> 8 );
+
+  if (sizeof ( hdr ) != fwrite(hdr, 1, sizeof ( hdr ), z))
+    {
+      return false;
+    }
+
+  size_t read;
+
+  while (0 < ( read = fread(in, 1, _LOG_LZ4_BLOCKSIZE, f)))
+    {
+      size_t len      = _log_lz4_block(in, read, out);
+      const void *blk = out;
+      uint8_t size[4];
+
+      if (len >= read)
+        {
+          /* Didn't compress; store it as it is. */
+          len = read;
+          blk = in;
+          _log_write32le(size, (uint32_t)len | _LOG_LZ4_RAW);
+        }
+      else
+        {
+          _log_write32le(size, (uint32_t)len);
+        }
+
+      if (sizeof ( size ) != fwrite(size, 1, sizeof ( size ), z)
+          || len != fwrite(blk, 1, len, z))
+        {
+          return false;
+        }
+    }
+
+  uint8_t endmark[4] = { 0 };
+
+  return !ferror(f)
+         && sizeof ( endmark ) == fwrite(endmark, 1, sizeof ( endmark ), z);
+}
+
+bool
+_log_compressfile(const logchar_t *path, logchar_t **outpath)
+{
+  if (!_log_validstr(path))
+    {
+      return false;
+    }
+
+  logchar_t zpath[LOG_MAXPATH] = { 0 };
+  int fmt = snprintf(zpath, LOG_MAXPATH, "%s%s", path, LOG_FCOMPRESSEXT);
+
+  if (fmt < 0 || fmt >= LOG_MAXPATH)
+    {
+      _log_handleerr(fmt < 0 ? errno : ENAMETOOLONG);
+      return false;
+    }
+
+  bool r       = false;
+  uint8_t *in  = (uint8_t *)malloc(_LOG_LZ4_BLOCKSIZE);
+  uint8_t *out = (uint8_t *)malloc(_log_lz4_bound(_LOG_LZ4_BLOCKSIZE));
+  FILE *f      = fopen(path, "rb");
+
+  if (in && out && f)
+    {
+      FILE *z = fopen(zpath, "wb");
+
+      if (z)
+        {
+          r = _log_lz4_writeframe(f, z, in, out);
+
+          if (0 != fclose(z))
+            {
+              r = false;
+            }
+
+          /* Keep the original until the compressed copy is complete. */
+          r = r && 0 == remove(path);
+
+          if (!r)
+            {
+              _log_handleerr(errno);
+              (void)remove(zpath);
+            }
+        }
+      else
+        {
+          _log_handleerr(errno);
+        }
+    }
+  else
+    {
+      _log_handleerr(errno);
+    }
+
+  if (f)
+    {
+      (void)fclose(f);
+    }
+
+  _log_safefree(in);
+  _log_safefree(out);
+
+  _log_selflog(
+    "%s: %s '%s' -> '%s'\n",
+    __func__,
+    r ? "compressed" : "failed to compress",
+    path,
+    zpath);
+
+  if (r && outpath)
+    {
+      *outpath = strdup(zpath);
+    }
+
+  return r;
+}
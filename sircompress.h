@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 104b998c-c9a3-11f1-a42e-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _LOG_COMPRESS_H_INCLUDED
+# define _LOG_COMPRESS_H_INCLUDED
+
+# include "sirtypes.h"
+
+/*
+ * Compresses a file in the LZ4 frame format (readable by lz4(1)), to a
+ * file of the same name with LOG_FCOMPRESSEXT appended, and removes the
+ * original. If anything fails, the original is left as it is. If outpath
+ * isn't NULL, it receives a copy of the new name, to be freed by the caller.
+ */
+
+bool _log_compressfile(const logchar_t *path, logchar_t **outpath);
+
+/*
+ * Compresses len bytes at src as a single LZ4 block. dst must have room
+ * for _log_lz4_bound(len) bytes. Returns the compressed length.
+ */
+
+size_t _log_lz4_block(const uint8_t *src, size_t len, uint8_t *dst);
+
+/* The most _log_lz4_block can write for an input of len bytes. */
+
+static inline size_t
+_log_lz4_bound(size_t len)
+{
+  return len + len / 255 + 16;
+}
+
+/*
+ * Writes the contents of f to z as an LZ4 frame, using in and out (of
+ * at least 64 KiB and _log_lz4_bound(64 KiB) bytes) as work space.
+ */
+
+bool _log_lz4_writeframe(FILE *f, FILE *z, uint8_t *in, uint8_t *out);
+
+/* The 32-bit xxHash of len bytes at src (used for frame checksums). */
+
+uint32_t _log_xxh32(const uint8_t *src, size_t len, uint32_t seed);
+
+#endif /* !_LOG_COMPRESS_H_INCLUDED */
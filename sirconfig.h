@@ -31,9 +31,12 @@
 
 # define LOG_TIMEFORMAT "%H:%M:%S"
 
-/* The format for the current millisecond in time stamps. */
+/*
+ * The character placed between the time stamp and the current millisecond
+ * (which is always formatted as three digits).
+ */
 
-# define LOG_MSECFORMAT ".%03lld"
+# define LOG_MSECSEPARATOR '.'
 
 /* The format for the human-readable logging level. */
 
@@ -53,10 +56,87 @@
 
 # define LOG_FOPENMODE "a"
 
-/* The size, in bytes, at which a log file will be rolled/archived. */
+/*
+ * The default size, in bytes, at which a log file will be rolled/archived
+ * (see log_fileroll).
+ */
 
 # define LOG_FROLLSIZE ( 1024L * 1024L * 1L )
 
+/*
+ * The size of a log file is tracked by counting the bytes written to it.
+ * Every LOG_FSIZESYNC writes, the count is checked against the file
+ * system, in order to notice changes made by others (e.g., truncation, or
+ * another process appending to the same file). 0 = never check.
+ */
+
+# define LOG_FSIZESYNC 1024
+
+/*
+ * The default size, in bytes, of the buffer for log files written with
+ * LOGB_FD (see log_filebackend), and the largest size that may be set.
+ */
+
+# define LOG_FBUFSIZE ( 64UL * 1024UL )
+# define LOG_FBUFMAX  ( 16UL * 1024UL * 1024UL )
+
+/*
+ * The size, in bytes, of the buffers for stdout and stderr when they aren't
+ * terminals (e.g. redirected to a file or a pipe), and the longest time, in
+ * milliseconds, that output is held in them before being written. Terminals
+ * are written to as each message is logged, and are the only destinations
+ * given styling sequences. Errors (see log_stderr_drain_lvls), and levels a
+ * log file syncs, are written out before the call that logs them returns.
+ */
+
+# define LOG_CONBUFSIZE   ( 64UL * 1024UL )
+# define LOG_CONFLUSHMSEC 100
+
+/*
+ * The most, in bytes, of a log file written with LOGB_MMAP that is
+ * preallocated and mapped at a time; the mapping is extended by this much
+ * whenever it fills before the file is rolled.
+ */
+
+# define LOG_FMAPSIZE ( 64UL * 1024UL * 1024UL )
+
+/*
+ * The alignment, in bytes, of the blocks a log file written with LOGB_DIRECT
+ * is written in (at least the file system's logical block size). Its buffer
+ * is rounded up to a multiple of this.
+ */
+
+# define LOG_FDIRECTALIGN 4096UL
+
+/*
+ * The flush timer, in milliseconds, a log file switched to LOGB_DIRECT gets
+ * in place of the default (unbuffered) flush policy; whole blocks buffered
+ * for longer are written.
+ */
+
+# define LOG_FDIRECTMSEC 1000
+
+/*
+ * The number of submission queue entries in the io_uring shared by LOGB_URING
+ * files. Each file has at most one write in flight, and the completion queue
+ * has room for twice this many, so it never overflows with up to
+ * 2 * LOG_URINGENTRIES such files (LOG_MAXFILES).
+ */
+
+# define LOG_URINGENTRIES 256
+
+/* The extension added to the names of compressed archives (log_filecompress). */
+
+# define LOG_FCOMPRESSEXT ".lz4"
+
+/*
+ * The most rolled files that may be waiting for the background helper
+ * thread to archive them at once; files due to be rolled while this many
+ * are waiting are rolled once there's room.
+ */
+
+# define LOG_ROLLQUEUE 16
+
 /*
  * The time format string in file headers (see LOG_FHFORMAT).
  */
@@ -79,8 +159,19 @@
 # define LOG_FHBEGIN  "Log begins at"
 # define LOG_FHROLLED "Log begins at"
 
+/*
+ * The format string included in LOG_FHFORMAT when a log file that failed to
+ * be written to is written to again.
+ * - The %llu format specifier is the number of messages dropped.
+ * - The %d is the last error that caused a write to fail.
+ */
+
+# define LOG_FHRESUMED "%llu message(s) dropped (error %d); log resumes at"
+
 /*
  * The time format string for rolled/archived log files (see LOG_FNAMEFORMAT).
+ * Archives left by earlier runs are only recognized (log_fileretain) if it
+ * produces nothing but digits and '-'.
  */
 
 # define LOG_FNAMETIMEFORMAT "%Y-%m-%d-%H%M%S"
@@ -97,6 +188,17 @@
 
 # define LOG_FNAMEFORMAT "%s-%s-%.3llu%s"
 
+/*
+ * The format string for the names of files that replace rolled files, until
+ * the background helper thread has archived the rolled file and renamed its
+ * replacement.
+ * - The %s format specifier is the original file name.
+ * - The %ld is the process identifier.
+ * - The %llu is an increasing sequence number.
+ */
+
+# define LOG_FROLLTMPFORMAT "%s.%ld-%.3llu.tmp"
+
 /* The human-readable form of the LOGL_EMERG level. */
 
 # define LOGL_S_EMERG    "EMRG"
@@ -129,9 +231,13 @@
 
 # define LOGL_S_DEBUG    "DEBG"
 
-/* The maximum number of log files that may be registered. */
+/*
+ * The maximum number of log files that may be registered. Room is made for
+ * LOG_FCACHEINIT at first, and doubled as necessary.
+ */
 
-# define LOG_MAXFILES 16
+# define LOG_MAXFILES   512
+# define LOG_FCACHEINIT 16
 
 /*
  * The maximum number of characters that may be included in one message,
@@ -176,6 +282,44 @@
   ( LOG_MAXMESSAGE + ( LOG_MAXSTYLE * 2 ) + LOG_MAXTIME + LOG_MAXLEVEL  \
     + LOG_MAXNAME  + ( LOG_MAXPID   * 2 ) + LOG_MAXMISC + 1 )
 
+/*
+ * The maximum number of segments that make up a line of formatted output
+ * (fields, separators and styling).
+ */
+
+# define LOG_MAXIOV 20
+
+/*
+ * The number of messages that may be queued for the background writer
+ * thread in asynchronous mode. Must be a power of two. If the queue is
+ * full, the calling thread waits until space is available.
+ */
+
+# define LOG_ASYNCQUEUE 256
+
+/*
+ * The maximum time, in milliseconds, that the background writer thread
+ * sleeps while there are no queued messages.
+ */
+
+# define LOG_ASYNCWAIT 100
+
+/*
+ * The maximum time, in milliseconds, that the background helper thread
+ * sleeps while it has nothing scheduled.
+ */
+
+# define LOG_WORKERWAIT 1000
+
+/*
+ * How long, in milliseconds, messages to a log file are dropped without
+ * trying to write them after a write fails. The time doubles with each
+ * write that fails in a row, up to LOG_FRETRYMAX.
+ */
+
+# define LOG_FRETRYMIN 100
+# define LOG_FRETRYMAX 30000
+
 /* The maximum size, in characters, of an error message. */
 
 # define LOG_MAXERROR 256
@@ -216,11 +360,11 @@
 #  define LOG_ENDSTYLE "\033[0m"
 
 /*
- * The default clock used to obtain the
- * current millisecond from clock_gettime.
+ * The clock used to obtain the current time (and millisecond) from
+ * clock_gettime.
  */
 
-#  define LOG_MSECCLOCK CLOCK_MONOTONIC
+#  define LOG_MSECCLOCK CLOCK_REALTIME
 
 # else /* ifndef _WIN32 */
 
@@ -25,92 +25,326 @@
  */
 
 #include "sirconsole.h"
+#include "sirfilecache.h"
 #include "sirinternal.h"
+#include "sirmutex.h"
 #include "sirtextstyle.h"
 
 #ifndef _WIN32
+# ifndef LOG_NO_ASYNC
+#  include "sirworker.h"
+# endif /* ifndef LOG_NO_ASYNC */
 
-static bool _log_write_std(const logchar_t *message, FILE *stream);
+static bool _log_write_std(logconsole *con, const logiovec *vec, bool drain);
+static bool _log_console_drain(logconsole *con);
+static void _log_console_once(void);
+static void _log_console_atexit(void);
+
+static logonce_t console_once = LOG_ONCE_INIT;
+
+static logchar_t stdout_buf[LOG_CONBUFSIZE];
+static logchar_t stderr_buf[LOG_CONBUFSIZE];
+
+static logconsole con_stdout;
+static logconsole con_stderr;
+
+void
+_log_console_init(void)
+{
+  _log_once(&console_once, _log_console_once);
+
+  /* Checked once per initialization, rather than per message. */
+  con_stdout.tty = 1 == isatty(STDOUT_FILENO);
+  con_stderr.tty = 1 == isatty(STDERR_FILENO);
+}
+
+bool
+_log_stdout_styled(void)
+{
+  return con_stdout.tty;
+}
+
+bool
+_log_stderr_styled(void)
+{
+  return con_stderr.tty;
+}
 
 bool
-_log_stderr_write(const logchar_t *message)
+_log_stderr_write(const logiovec *vec, bool drain)
 {
-  return _log_write_std(message, stderr);
+  return _log_write_std(&con_stderr, vec, drain);
 }
 
 bool
-_log_stdout_write(const logchar_t *message)
+_log_stdout_write(const logiovec *vec, bool drain)
 {
-  return _log_write_std(message, stdout);
+  return _log_write_std(&con_stdout, vec, drain);
+}
+
+bool
+_log_console_flush(void)
+{
+  bool flush = true;
+  logconsole *cons[2] = { &con_stdout, &con_stderr };
+
+  for (size_t n = 0; n < 2; n++)
+    {
+      if (_logmutex_lock(&cons[n]->mutex))
+        {
+          flush &= _log_console_drain(cons[n]);
+          flush &= _logmutex_unlock(&cons[n]->mutex);
+        }
+    }
+
+  return flush;
+}
+
+uint32_t
+_log_console_tick(void)
+{
+  uint32_t wait       = LOG_WORKERWAIT;
+  uint64_t now        = _log_getmsec();
+  logconsole *cons[2] = { &con_stdout, &con_stderr };
+
+  for (size_t n = 0; n < 2; n++)
+    {
+      if (!_logmutex_lock(&cons[n]->mutex))
+        {
+          continue;
+        }
+
+      if (cons[n]->len > 0)
+        {
+          uint64_t due = cons[n]->since + LOG_CONFLUSHMSEC;
+
+          if (due <= now)
+            {
+              (void)_log_console_drain(cons[n]);
+            }
+          else if (due - now < wait)
+            {
+              wait = (uint32_t)( due - now );
+            }
+        }
+
+      (void)_logmutex_unlock(&cons[n]->mutex);
+    }
+
+  return wait;
 }
 
 static bool
-_log_write_std(const logchar_t *message, FILE *stream)
+_log_write_std(logconsole *con, const logiovec *vec, bool drain)
 {
   (void)log_override_styles;
-  if (!_log_validstr(message) || !_log_validptr(stream))
+  if (!_log_validptr(vec))
     {
       return false;
     }
 
-  if (EOF == fputs(message, stream))
+  /*
+   * Terminals receive each line with a single writev (after anything
+   * already buffered by stdio). Otherwise, lines are gathered in a buffer
+   * and written together, within LOG_CONFLUSHMSEC.
+   */
+  if (con->tty)
+    {
+      _log_fflush(con->stream);
+      return _log_writev(con->fd, vec);
+    }
+
+  if (!_logmutex_lock(&con->mutex))
     {
-      _log_handleerr(errno);
       return false;
     }
 
-  return true;
+  bool wrote = true;
+
+  if (con->len + vec->len > LOG_CONBUFSIZE)
+    {
+      wrote = _log_console_drain(con);
+    }
+
+  bool first = 0 == con->len;
+
+  if (first)
+    {
+      con->since = _log_getmsec();
+    }
+
+  for (int n = 0; n < vec->count; n++)
+    {
+      (void)memcpy(con->buf + con->len, vec->iov[n].iov_base, vec->iov[n].iov_len);
+      con->len += vec->iov[n].iov_len;
+    }
+
+# ifndef LOG_NO_ASYNC
+  /* The helper thread writes it in time; without it, there's no waiting. */
+  bool due = first && !_log_worker_start();
+# else  /* ifndef LOG_NO_ASYNC */
+  bool due = _log_getmsec() - con->since >= LOG_CONFLUSHMSEC;
+# endif /* ifndef LOG_NO_ASYNC */
+
+  /* Not left waiting, in case the process doesn't live to write it. */
+  due |= drain;
+
+  if (due)
+    {
+      wrote &= _log_console_drain(con);
+    }
+
+  (void)_logmutex_unlock(&con->mutex);
+
+# ifndef LOG_NO_ASYNC
+  if (first && !due)
+    {
+      _log_worker_wake();
+    }
+# endif /* ifndef LOG_NO_ASYNC */
+
+  return wrote;
+}
+
+static bool
+_log_console_drain(logconsole *con)
+{
+  if (0 == con->len)
+    {
+      return true;
+    }
+
+  /* Output the application wrote through stdio goes first. */
+  _log_fflush(con->stream);
+
+  logiovec vec = {
+    0
+  };
+
+  _log_iovappend(&vec, con->buf, con->len);
+  con->len = 0;
+
+  return _log_writev(con->fd, &vec);
+}
+
+static void
+_log_console_once(void)
+{
+  con_stdout.fd     = STDOUT_FILENO;
+  con_stdout.stream = stdout;
+  con_stdout.buf    = stdout_buf;
+  _log_initmutex(&con_stdout.mutex);
+
+  con_stderr.fd     = STDERR_FILENO;
+  con_stderr.stream = stderr;
+  con_stderr.buf    = stderr_buf;
+  _log_initmutex(&con_stderr.mutex);
+
+  /* Like stdio's, the buffers are written at exit, without log_cleanup. */
+  if (0 != atexit(_log_console_atexit))
+    {
+      _log_selflog("%s: atexit failed\n", __func__);
+    }
+}
+
+void
+_log_console_atfork_prepare(void)
+{
+  _log_once(&console_once, _log_console_once);
+
+  /* Written once, by the parent. */
+  (void)_log_console_flush();
+  (void)_logmutex_lock(&con_stdout.mutex);
+  (void)_logmutex_lock(&con_stderr.mutex);
+}
+
+void
+_log_console_atfork_parent(void)
+{
+  (void)_logmutex_unlock(&con_stderr.mutex);
+  (void)_logmutex_unlock(&con_stdout.mutex);
+}
+
+void
+_log_console_atfork_child(void)
+{
+  con_stdout.len = 0;
+  con_stderr.len = 0;
+  _log_console_atfork_parent();
+}
+
+static void
+_log_console_atexit(void)
+{
+  (void)_log_console_flush();
 }
 
 #else /* ifndef _WIN32 */
 
+bool
+_log_stdout_styled(void)
+{
+  /* Styling uses console attributes rather than escape sequences. */
+  return true;
+}
+
+bool
+_log_stderr_styled(void)
+{
+  return true;
+}
+
 static CRITICAL_SECTION stdout_cs;
 static logonce_t stdout_once = LOG_ONCE_INIT;
 
 static CRITICAL_SECTION stderr_cs;
 static logonce_t stderr_once = LOG_ONCE_INIT;
 
-static bool _log_write_stdwin32(uint16_t style, const logchar_t *message,
-                                HANDLE console, CRITICAL_SECTION *cs);
+static bool _log_write_stdwin32(const logiovec *vec, HANDLE console,
+                                CRITICAL_SECTION *cs);
 static BOOL CALLBACK _log_initcs(PINIT_ONCE ponce, PVOID param, PVOID *ctx);
 
 bool
-_log_stderr_write(uint16_t style, const logchar_t *message)
+_log_stderr_write(const logiovec *vec, bool drain)
 {
   BOOL initcs
     = InitOnceExecuteOnce(&stderr_once, _log_initcs, &stderr_cs, NULL);
 
   assert(FALSE != initcs);
-  return _log_write_stdwin32(
-    style,
-    message,
-    GetStdHandle(STD_ERROR_HANDLE),
-    &stderr_cs);
+  (void)drain;
+  return _log_write_stdwin32(vec, GetStdHandle(STD_ERROR_HANDLE), &stderr_cs);
 }
 
 bool
-_log_stdout_write(uint16_t style, const logchar_t *message)
+_log_stdout_write(const logiovec *vec, bool drain)
 {
   BOOL initcs
     = InitOnceExecuteOnce(&stdout_once, _log_initcs, &stdout_cs, NULL);
 
   assert(FALSE != initcs);
-  return _log_write_stdwin32(
-    style,
-    message,
-    GetStdHandle(STD_OUTPUT_HANDLE),
-    &stdout_cs);
+  (void)drain;
+  return _log_write_stdwin32(vec, GetStdHandle(STD_OUTPUT_HANDLE), &stdout_cs);
 }
 
 static bool
-_log_write_stdwin32(uint16_t style, const logchar_t *message, HANDLE console,
-                    CRITICAL_SECTION *cs)
+_log_write_stdwin32(const logiovec *vec, HANDLE console, CRITICAL_SECTION *cs)
 {
-  if (!_log_validstr(message))
+  if (!_log_validptr(vec))
     {
       return false;
     }
 
+  /* WriteConsole takes one contiguous string. */
+  logchar_t message[LOG_MAXOUTPUT] = {
+    0
+  };
+  size_t len = 0;
+
+  for (int n = 0; n < vec->count; n++)
+    {
+      len = _log_strappend(message, len, vec->iov[n].iov_base, vec->iov[n].iov_len);
+    }
+
   assert(INVALID_HANDLE_VALUE != console);
   if (INVALID_HANDLE_VALUE == console)
     {
@@ -131,16 +365,19 @@ _log_write_stdwin32(uint16_t style, const logchar_t *message, HANDLE console,
   if (!GetConsoleScreenBufferInfo(console, &csbfi))
     {
       _log_handlewin32err(GetLastError());
+      LeaveCriticalSection(cs);
       return false;
     }
 
-  if (!SetConsoleTextAttribute(console, style))
+  if (0 != vec->style && !SetConsoleTextAttribute(console, vec->style))
     {
       _log_handlewin32err(GetLastError());
+      LeaveCriticalSection(cs);
       return false;
     }
 
-  size_t chars = strnlen(message, LOG_MAXOUTPUT) - 1;
+  /* Omit the trailing newline. */
+  size_t chars = len > 0 ? len - 1 : 0;
   DWORD written = 0;
 
   do
@@ -29,12 +29,41 @@
 
 # include "sirtypes.h"
 
+/**
+ * Writes a message to stderr or stdout; unless drain, it may be buffered
+ * for up to LOG_CONFLUSHMSEC (not on Windows, where it never is).
+ */
+bool _log_stderr_write(const logiovec *vec, bool drain);
+bool _log_stdout_write(const logiovec *vec, bool drain);
+
 # ifndef _WIN32
-bool _log_stderr_write(const logchar_t *message);
-bool _log_stdout_write(const logchar_t *message);
-# else  /* ifndef _WIN32 */
-bool _log_stderr_write(uint16_t style, const logchar_t *message);
-bool _log_stdout_write(uint16_t style, const logchar_t *message);
+/** Looks up whether stdout and stderr are terminals; called by _log_init. */
+void _log_console_init(void);
+
+/** Writes the messages buffered for stdout and stderr. */
+bool _log_console_flush(void);
+
+/**
+ * Writes buffered console output which has waited LOG_CONFLUSHMSEC; called
+ * by the helper thread. Returns the number of milliseconds until the next
+ * write is due (at most LOG_WORKERWAIT).
+ */
+uint32_t _log_console_tick(void);
+
+/** Writes buffered output, and locks the buffers, before fork. */
+void _log_console_atfork_prepare(void);
+
+/** Unlocks the buffers after fork, in the parent process. */
+void _log_console_atfork_parent(void);
+
+/** Unlocks the buffers after fork, in the child process. */
+void _log_console_atfork_child(void);
 # endif /* ifndef _WIN32 */
 
+/** Whether messages written to stdout should contain styling sequences. */
+bool _log_stdout_styled(void);
+
+/** Whether messages written to stderr should contain styling sequences. */
+bool _log_stderr_styled(void);
+
 #endif /* !_LOG_CONSOLE_H_INCLUDED */
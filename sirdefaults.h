@@ -44,6 +44,14 @@ static const log_options log_stdout_def_opts
 static const log_levels log_stderr_def_lvls
   = LOGL_ERROR | LOGL_CRIT | LOGL_EMERG;
 
+/*
+ * Levels written out to stderr, when it isn't a terminal, before the call
+ * that logged them returns, rather than left buffered.
+ */
+
+static const log_levels log_stderr_drain_lvls
+  = LOGL_ERROR | LOGL_CRIT | LOGL_ALERT | LOGL_EMERG;
+
 /* Default options for stderr. */
 
 static const log_options log_stderr_def_opts
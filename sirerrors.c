@@ -152,6 +152,12 @@ __log_handlewin32err(DWORD code, const logchar_t *func, const logchar_t *file,
 }
 #endif /* ifdef _WIN32 */
 
+int
+_log_getoserror(void)
+{
+  return log_te.os_error;
+}
+
 logerror_t
 _log_geterror(logchar_t message[LOG_MAXERROR - 1])
 {
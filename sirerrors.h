@@ -124,6 +124,10 @@ void __log_handlewin32err(DWORD code, const logchar_t *func,
 
 logerror_t _log_geterror(logchar_t message[LOG_MAXERROR - 1]);
 
+/* Returns the code of the last platform error that occurred (or 0). */
+
+int _log_getoserror(void);
+
 # ifdef LOG_SELFLOG
 
 /* Log an internal message to stderr. */
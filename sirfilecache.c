@@ -25,11 +25,15 @@
  */
 
 #include "sirfilecache.h"
+#include "sircompress.h"
 #include "sirdefaults.h"
 #include "sirinternal.h"
 #include "sirmutex.h"
+#include "sirthread.h"
+#include "siruring.h"
+#include "sirworker.h"
 
-volatile unsigned long long int log_sequence_counter = 0;
+atomic_ullong log_sequence_counter = 0;
 
 logfileid_t
 _log_addfile(const logchar_t *path, log_levels levels, log_options opts)
@@ -38,6 +42,11 @@ _log_addfile(const logchar_t *path, log_levels levels, log_options opts)
 
   if (_log_sanity())
     {
+#ifndef LOG_NO_ASYNC
+      /* A file at path that was just rolled may not be archived yet. */
+      _log_worker_waitrolls();
+#endif /* ifndef LOG_NO_ASYNC */
+
       logfcache *sfc = _log_locksection(_LOGM_FILECACHE);
       assert(sfc);
 
@@ -47,6 +56,8 @@ _log_addfile(const logchar_t *path, log_levels levels, log_options opts)
           _log_defaultopts   (&opts,   log_file_def_opts);
 
           logfileid_t r = _log_fcache_add(sfc, path, levels, opts);
+          _log_fcache_route(sfc);
+          _log_updatefclevels(sfc);
           (void)_log_unlocksection(_LOGM_FILECACHE);
           return r;
         }
@@ -63,12 +74,30 @@ _log_updatefile(logfileid_t id, log_update_data *data)
   if (_log_sanity() && _log_validptr(id) && _log_validfid(*id)
       && _log_validupdatedata(data))
     {
+#ifndef LOG_NO_ASYNC
+      /* Changing the writer reopens the file, by name. */
+      if (data->writer)
+        {
+          _log_worker_waitrolls();
+        }
+#endif /* ifndef LOG_NO_ASYNC */
+
       logfcache *sfc = _log_locksection(_LOGM_FILECACHE);
       assert(sfc);
 
       if (sfc)
         {
           bool r = _log_fcache_update(sfc, id, data);
+          _log_fcache_route(sfc);
+          _log_updatefclevels(sfc);
+
+#ifndef LOG_NO_ASYNC
+          if (r && (( data->flush && 0 != data->flush->msec )
+                    || ( data->writer && LOGB_DIRECT == data->writer->type )))
+            {
+              r &= _log_worker_start();
+            }
+#endif /* ifndef LOG_NO_ASYNC */
           return _log_unlocksection(_LOGM_FILECACHE) && r;
         }
     }
@@ -89,6 +118,8 @@ _log_remfile(logfileid_t id)
       if (sfc)
         {
           bool r = _log_fcache_rem(sfc, id);
+          _log_fcache_route(sfc);
+          _log_updatefclevels(sfc);
           return _log_unlocksection(_LOGM_FILECACHE) && r;
         }
     }
@@ -115,11 +146,36 @@ _logfile_create(const logchar_t *path, log_levels levels, log_options opts)
             {
               (void)strncpy(sf->path, path, pathLen);
 
-              sf->levels = levels;
-              sf->opts   = opts;
+              sf->levels      = levels;
+              sf->opts        = opts;
+              sf->id          = LOG_INVALID;
+              sf->flush.count = 1;
+              sf->roll.size   = LOG_FROLLSIZE;
+
+              if (!_logmutex_create(&sf->mutex))
+                {
+                  _log_safefree(sf->path);
+                  _log_safefree(sf);
+                  return NULL;
+                }
+
+#ifndef LOG_NO_ASYNC
+              if (!_logcond_create(&sf->sync.cond))
+                {
+                  (void)_logmutex_destroy(&sf->mutex);
+                  _log_safefree(sf->path);
+                  _log_safefree(sf);
+                  return NULL;
+                }
+#endif /* ifndef LOG_NO_ASYNC */
 
               if (!_logfile_open(sf) || !_logfile_validate(sf))
                 {
+#ifndef LOG_NO_ASYNC
+                  (void)_logcond_destroy(&sf->sync.cond);
+#endif /* ifndef LOG_NO_ASYNC */
+                  (void)_logmutex_destroy(&sf->mutex);
+                  _log_safefree(sf->path);
                   _log_safefree(sf);
                   return NULL;
                 }
@@ -133,9 +189,62 @@ _logfile_create(const logchar_t *path, log_levels levels, log_options opts)
 bool
 _logfile_open(logfile *sf)
 {
-  if (_log_validptr(sf) && _log_validstr(sf->path))
+  return _log_validptr(sf) && _logfile_openpath(sf, sf->path);
+}
+
+bool
+_logfile_openpath(logfile *sf, const logchar_t *path)
+{
+  if (_log_validptr(sf) && _log_validstr(path))
     {
-      FILE *f = _log_fopen(sf->path);
+#ifndef _WIN32
+      if (LOGB_STDIO != sf->writer.type)
+        {
+          bool mapped    = LOGB_MMAP == sf->writer.type;
+          bool direct    = LOGB_DIRECT == sf->writer.type;
+          int fd         = direct ? _log_fdopendirect(path)
+                                  : _log_fdopen(path, mapped ? O_RDWR : O_WRONLY | O_APPEND);
+          logchar_t *map = NULL;
+          size_t maplen  = 0;
+          uint64_t size  = 0;
+
+          if (LOG_INVALID != fd && mapped
+              && !_log_fdmap(fd, _logfile_maplen(sf, 0, 0), &map, &maplen, &size))
+            {
+              (void)close(fd);
+              fd = LOG_INVALID;
+            }
+
+          if (LOG_INVALID != fd)
+            {
+              _logfile_close(sf);
+
+              sf->id     = fd;
+              sf->map    = map;
+              sf->maplen = maplen;
+
+              if (mapped)
+                {
+                  sf->size = size;
+                }
+
+              (void)_logfile_syncsize(sf);
+              _logfile_setrollat(sf);
+              _logfile_preallocate(sf);
+
+              if (direct)
+                {
+                  (void)_logfile_readtail(sf);
+                }
+
+              return true;
+            }
+
+          return false;
+        }
+#endif /* ifndef _WIN32 */
+
+      FILE *f = _log_fopen(path);
 
       if (f)
         {
@@ -151,6 +260,9 @@ _logfile_open(logfile *sf)
 
               sf->f  = f;
               sf->id = fd;
+              (void)_logfile_syncsize(sf);
+              _logfile_setrollat(sf);
+              _logfile_preallocate(sf);
               return true;
             }
         }
@@ -164,45 +276,131 @@ _logfile_close(logfile *sf)
 {
   if (_log_validptr(sf))
     {
+      /* Durable messages written to it are synced before it's closed. */
+      if (sf->sync.synced < sf->sync.queued && LOG_INVALID != sf->id)
+        {
+          (void)_logfile_sync(sf, false);
+        }
+
       if (_log_validptr(sf->f) && _log_validfid(sf->id))
         {
           _log_fflush(sf->f);
+          _logfile_release(sf);
           _log_fclose(&sf->f);
-          sf->id = LOG_INVALID;
+          sf->id      = LOG_INVALID;
+          sf->pending = 0;
+        }
+#ifndef _WIN32
+      else if (LOG_INVALID != sf->id)
+        {
+          (void)_logfile_writebuf(sf);
+
+# ifdef LOG_URING
+          _log_uring_wait(sf);
+# endif /* ifdef LOG_URING */
+
+          _logfile_release(sf);
+
+          if (_log_validptr(sf->map))
+            {
+              _log_fdunmap(sf->id, &sf->map, sf->maplen, sf->size);
+              sf->maplen = 0;
+            }
+
+          if (0 != close(sf->id))
+            {
+              _log_handleerr(errno);
+            }
+
+          sf->id      = LOG_INVALID;
+          sf->pending = 0;
         }
+#endif /* ifndef _WIN32 */
     }
 }
 
 bool
-_logfile_write(logfile *sf, const logchar_t *output)
+_logfile_write(logfile *sf, const logiovec *vec)
 {
-  if (_logfile_validate(sf) && _log_validstr(output))
+  if (_logfile_validate(sf) && _log_validptr(vec))
     {
       if (_logfile_needsroll(sf))
         {
-          bool rolled        = false;
-          logchar_t *newpath = NULL;
+          bool deferred = false;
 
-          if (_logfile_roll(sf, &newpath))
+          if (_logfile_roll(sf, &deferred))
             {
               logchar_t header[LOG_MAXMESSAGE] = { 0 };
               (void)snprintf(header, LOG_MAXMESSAGE, LOG_FHROLLED);
-              rolled = _logfile_writeheader(sf, header);
-            }
 
-          _log_safefree(newpath);
-          if (!rolled)
+              if (!_logfile_writeheader(sf, header))
+                {
+                  return false;
+                }
+            }
+          else if (!deferred)
             {
               return false;
             }
         }
 
-      size_t writeLen = strnlen(output, LOG_MAXOUTPUT);
-      size_t write    = fwrite(output, sizeof ( logchar_t ), writeLen, sf->f);
+#ifndef _WIN32
+      if (LOGB_MMAP == sf->writer.type)
+        {
+          return _logfile_mapwrite(sf, vec);
+        }
+
+      if (LOGB_DIRECT == sf->writer.type)
+        {
+          return _logfile_directwrite(sf, vec);
+        }
+
+      /* LOGB_URING files are written in batches, even if unbuffered. */
+      if (LOGB_URING == sf->writer.type
+          || ( LOGB_FD == sf->writer.type && 1 != sf->flush.count ))
+        {
+          return _logfile_bufwrite(sf, vec);
+        }
+
+      if (1 == sf->flush.count)
+        {
+          /* Unbuffered; straight to the file. */
+          bool write = _log_writev(sf->id, vec);
+
+          if (write)
+            {
+              sf->size += vec->len;
+            }
+          else
+            {
+              _log_selflog(
+                "%s: failed to write %'lu bytes to %d\n",
+                __func__,
+                vec->len,
+                sf->id);
+            }
+
+          return write;
+        }
+#endif /* ifndef _WIN32 */
+
+      size_t write = 0;
+
+      for (int n = 0; n < vec->count; n++)
+        {
+          size_t seg = fwrite(vec->iov[n].iov_base, 1, vec->iov[n].iov_len, sf->f);
+          write += seg;
+
+          if (seg < vec->iov[n].iov_len)
+            {
+              break;
+            }
+        }
 
-      assert(write == writeLen);
+      assert(write == vec->len);
+      sf->size += write;
 
-      if (write < writeLen)
+      if (write < vec->len)
         {
           int err = ferror(sf->f);
           int eof = feof(sf->f);
@@ -214,251 +412,1618 @@ _logfile_write(logfile *sf, const logchar_t *output)
             "%s: wrote %'lu/%'lu bytes to %d; ferror: %d, feof: %d\n",
             __func__,
             write,
-            writeLen,
+            vec->len,
             sf->id,
             err,
             eof);
 
           /*
-           * TODO: If an error occurs on write, consider
-           * removing file from targets, or at least attempt
-           * to roll the file (out of space?)
+           * The caller stops writing to the file for a while (see
+           * _logfile_fault), rather than try again with every message.
            */
 
           clearerr(sf->f);
         }
 
-      return write == writeLen;
+      return write == vec->len;
     }
 
   return false;
 }
 
-bool
-_logfile_writeheader(logfile *sf, const logchar_t *msg)
+void
+_logfile_applyflush(logfile *sf, log_level level)
 {
-  if (_logfile_validate(sf) && _log_validstr(msg))
+  if (_log_bittest(sf->sync.levels, level))
     {
-      time_t now;
-      bool gettime = _log_getlocaltime(&now, NULL);
-      assert(gettime);
+      /* Out of every buffer, to be synced by _logfile_commit. */
+      _logfile_flush(sf);
+#ifdef LOG_URING
+      _log_uring_wait(sf);
+#endif /* ifdef LOG_URING */
+      sf->sync.queued++;
+      return;
+    }
 
-      if (gettime)
+#ifndef _WIN32
+  if (1 == sf->flush.count && LOGB_URING != sf->writer.type
+      && LOGB_DIRECT != sf->writer.type)
+    {
+      return; /* Already written. */
+    }
+#endif /* ifndef _WIN32 */
+
+  if (0 == sf->pending++)
+    {
+      sf->since = _log_getmsec();
+
+#ifndef LOG_NO_ASYNC
+      if (0 != sf->flush.msec)
         {
-          logchar_t timestamp[LOG_MAXTIME] = { 0 };
-          bool fmttime = _log_formattime(now, timestamp, LOG_FHTIMEFORMAT);
-          assert(fmttime);
+          _log_worker_wake();
+        }
+#endif /* ifndef LOG_NO_ASYNC */
+    }
 
-          if (fmttime)
-            {
-              logchar_t header[LOG_MAXOUTPUT] = { 0 };
-              int fmt = snprintf(header, LOG_MAXOUTPUT, LOG_FHFORMAT, msg, timestamp);
+  bool flush = ( 0 != sf->flush.count && sf->pending >= sf->flush.count )
+               || _log_bittest(sf->flush.levels, level);
 
-              if (fmt < 0)
-                {
-                  _log_handleerr(errno);
-                }
+#ifdef LOG_NO_ASYNC
+  /* Without the helper thread, timed flushes happen as messages arrive. */
+  flush |= 0 != sf->flush.msec
+           && _log_getmsec() - sf->since >= sf->flush.msec;
+#endif /* ifdef LOG_NO_ASYNC */
 
-              return fmt >= 0 && _logfile_write(sf, header);
+  if (flush)
+    {
+#if defined(LOG_URING) && !defined(LOG_NO_ASYNC)
+      /*
+       * Rather than wait for the file's last write to complete, keep
+       * buffering; the next message, or the helper thread, writes it.
+       */
+      if (LOGB_URING == sf->writer.type && _log_uring_busy(sf)
+          && _log_worker_start())
+        {
+          if (!atomic_exchange(&sf->deferred, true))
+            {
+              _log_worker_wake();
             }
+
+          return;
         }
-    }
+#endif /* if defined(LOG_URING) && !defined(LOG_NO_ASYNC) */
 
-  return false;
+      _logfile_flushpolicy(sf);
+    }
 }
 
+#ifndef _WIN32
 bool
-_logfile_needsroll(logfile *sf)
+_logfile_bufwrite(logfile *sf, const logiovec *vec)
 {
-  if (_logfile_validate(sf))
+  if (sf->buflen + vec->len > sf->writer.bufsize)
     {
-      struct stat st = { 0 };
-      int getstat = fstat(sf->id, &st);
+      /* Make room; the buffer only ever holds whole messages. */
+      _logfile_flush(sf);
+    }
 
-      if (0 != getstat)
+  if (vec->len > sf->writer.bufsize)
+    {
+#ifdef LOG_URING
+      /* After what's already on its way. */
+      _log_uring_wait(sf);
+#endif /* ifdef LOG_URING */
+
+      /* Too big to buffer at all; straight to the file. */
+      if (!_log_writev(sf->id, vec))
         {
-          _log_handleerr(errno);
+          _log_selflog(
+            "%s: failed to write %'lu bytes to %d\n",
+            __func__,
+            vec->len,
+            sf->id);
           return false;
         }
-
-      return st.st_size >= LOG_FROLLSIZE;
+    }
+  else
+    {
+      for (int n = 0; n < vec->count; n++)
+        {
+          (void)memcpy(sf->buf + sf->buflen, vec->iov[n].iov_base,
+                       vec->iov[n].iov_len);
+          sf->buflen += vec->iov[n].iov_len;
+        }
     }
 
-  return false;
+  sf->size += vec->len;
+  return true;
 }
 
 bool
-_logfile_roll(logfile *sf, logchar_t **newpath)
+_logfile_mapwrite(logfile *sf, const logiovec *vec)
 {
-  if (_logfile_validate(sf) && newpath)
+  if (sf->size + vec->len > sf->maplen)
     {
-      bool r          = false;
-      logchar_t *name = NULL;
-      logchar_t *ext  = NULL;
+      /* Full before the file was rolled (e.g. no size limit); extend it. */
+      logchar_t *map = NULL;
+      size_t maplen  = 0;
+      uint64_t size  = 0;
 
-      bool split = _logfile_splitpath(sf, &name, &ext);
-      assert(split);
+      _log_fdunmap(sf->id, &sf->map, sf->maplen, sf->size);
+      sf->maplen = 0;
 
-      if (split)
+      if (!_log_fdmap(sf->id, _logfile_maplen(sf, sf->size, vec->len), &map,
+                      &maplen, &size))
         {
-          time_t now;
+          return false;
+        }
 
-          bool gettime = _log_getlocaltime(&now, NULL);
-          assert(gettime);
+      sf->map    = map;
+      sf->maplen = maplen;
+    }
 
-          if (gettime)
-            {
-              logchar_t timestamp[LOG_MAXTIME] = {
-                0
-              };
-              bool fmttime = _log_formattime(now, timestamp, LOG_FNAMETIMEFORMAT);
-              assert(fmttime);
+  logchar_t *tail = sf->map + sf->size;
 
-              if (fmttime)
-                {
-                  *newpath = (logchar_t *)calloc(LOG_MAXPATH, sizeof ( logchar_t ));
+  for (int n = 0; n < vec->count; n++)
+    {
+      (void)memcpy(tail, vec->iov[n].iov_base, vec->iov[n].iov_len);
+      tail += vec->iov[n].iov_len;
+    }
 
-                  if (_log_validptr(*newpath))
-                    {
-                      int fmtpath
-                        = snprintf(
-                            *newpath,
-                            LOG_MAXPATH,
-                            LOG_FNAMEFORMAT,
-                            name,
-                            timestamp,
-                            log_sequence_counter++,
-                            _log_validstrnofail(ext) ? ext : "");
-
-                      if (fmtpath < 0)
-                        {
-                          _log_handleerr(errno);
-                        }
+  sf->size += vec->len;
+  return true;
+}
 
-                      if (access(*newpath, F_OK) == 0)
-                        {
-                          _log_safefree(name);
-                          _log_safefree(ext);
-                          return NULL;
-                        }
+bool
+_logfile_writebuf(logfile *sf)
+{
+  if (0 == sf->buflen)
+    {
+      return true;
+    }
 
-                      r = fmtpath >= 0 && _logfile_archive(sf, *newpath);
-                    }
-                }
-            }
+  if (LOGB_DIRECT == sf->writer.type)
+    {
+      return _logfile_writeblocks(sf, true);
+    }
+
+#ifdef LOG_URING
+  if (LOGB_URING == sf->writer.type && _log_uring_start())
+    {
+      /* Written from the other buffer, once it's free; this one is reused. */
+      _log_uring_wait(sf);
+
+      logchar_t *buf  = sf->inflight;
+      sf->inflight     = sf->buf;
+      sf->inflightlen  = sf->buflen;
+      sf->inflightmsgs = sf->pending;
+      sf->buf          = buf;
+      sf->buflen       = 0;
+
+      if (!_log_uring_write(sf))
+        {
+          /* Written here instead; a failure is seen by _logfile_uringfault. */
+          _log_uring_complete(sf, 0);
         }
 
-      _log_safefree(name);
-      _log_safefree(ext);
-      return r;
+      return true;
     }
+#endif /* ifdef LOG_URING */
 
-  return false;
+  logiovec vec = {
+    0
+  };
+
+  _log_iovappend(&vec, sf->buf, sf->buflen);
+
+  bool write = _log_writev(sf->id, &vec);
+
+  if (!write)
+    {
+      _log_selflog(
+        "%s: failed to write %'lu buffered bytes to %d\n",
+        __func__,
+        sf->buflen,
+        sf->id);
+    }
+
+  /* Like stdio, output that couldn't be written is discarded. */
+  sf->buflen = 0;
+  return write;
 }
 
 bool
-_logfile_archive(logfile *sf, const logchar_t *newpath)
+_logfile_directwrite(logfile *sf, const logiovec *vec)
 {
-  if (_logfile_validate(sf) && _log_validstr(newpath))
+  bool write = true;
+
+  for (int n = 0; n < vec->count; n++)
     {
-#ifdef _WIN32
-      /* Need to close the old file first on windows. */
-      _logfile_close(sf);
-#endif /* ifdef _WIN32 */
+      const logchar_t *src = (const logchar_t *)vec->iov[n].iov_base;
+      size_t left          = vec->iov[n].iov_len;
 
-      if (access(newpath, F_OK) == 0)
+      while (left > 0)
         {
-          _log_selflog(
-            "%s: '%s' exists!\n",
-            __func__,
-            newpath);
-          return false;
-        }
+          if (sf->buflen == sf->writer.bufsize)
+            {
+              write &= _logfile_writeblocks(sf, false);
+            }
 
-      if (0 != rename(sf->path, newpath))
-        {
-          _log_handleerr(errno);
-          return false;
-        }
+          size_t copy = sf->writer.bufsize - sf->buflen;
 
-      if (_logfile_open(sf))
-        {
-          _log_selflog(
-            "%s: archived '%s' -> '%s'\n",
-            __func__,
-            sf->path,
-            newpath);
-          return true;
+          if (copy > left)
+            {
+              copy = left;
+            }
+
+          (void)memcpy(sf->buf + sf->buflen, src, copy);
+          sf->buflen += copy;
+          src        += copy;
+          left       -= copy;
         }
     }
 
-  return false;
+  sf->size += vec->len;
+  return write;
 }
 
 bool
-_logfile_splitpath(logfile *sf, logchar_t **name, logchar_t **ext)
+_logfile_writeblocks(logfile *sf, bool tail)
 {
-  if (name)
-    {
-      *name = NULL;
-    }
+  size_t blocks = sf->buflen / LOG_FDIRECTALIGN * LOG_FDIRECTALIGN;
+  size_t len    = blocks;
+  bool padded   = false;
 
-  if (ext)
+  if (tail && sf->buflen > blocks && sf->buflen > sf->bufsynced)
     {
-      *ext = NULL;
+      /* Zeros, which are truncated away once written. */
+      len    = blocks + LOG_FDIRECTALIGN;
+      padded = true;
+      (void)memset(sf->buf + sf->buflen, 0, len - sf->buflen);
     }
 
-  if (_logfile_validate(sf) && _log_validptr(name) && _log_validptr(ext))
+  bool write  = true;
+  size_t done = 0;
+
+  while (done < len)
     {
-      logchar_t *lastfullstop = strrchr(sf->path, '.');
+      ssize_t wrote = pwrite(sf->id, sf->buf + done, len - done,
+                             (off_t)( sf->bufoff + done ));
 
-      if (lastfullstop)
+      if (wrote < 0)
         {
-          uintptr_t namesize = lastfullstop - sf->path;
-          assert(namesize < LOG_MAXPATH);
-
-          if (namesize < LOG_MAXPATH)
+          if (EINTR == errno)
             {
-              *name = (logchar_t *)calloc(namesize + 1, sizeof ( logchar_t ));
-              if (*name == NULL)
-                {
-                  return false;
-                }
-              (void)strncpy(*name, sf->path, namesize);
+              continue;
             }
 
-          *ext = strdup(lastfullstop);
+          _log_handleerr(errno);
+          write = false;
+          break;
         }
-      else
+
+      /* Only retried from a block boundary; O_DIRECT needs nothing else. */
+      size_t next = ( done + (size_t)wrote ) / LOG_FDIRECTALIGN
+                    * LOG_FDIRECTALIGN;
+
+      if (next == done)
         {
-          *name = strdup(sf->path);
+          _log_handleerr(EIO);
+          write = false;
+          break;
         }
 
-      return _log_validstr(*name) && ( !lastfullstop || _log_validstr(*ext));
+      done = next;
     }
 
-  return false;
-}
-
-void
-_logfile_destroy(logfile *sf)
+  if (!write)
+    {
+      _log_selflog(
+        "%s: failed to write %'lu buffered bytes to %d\n",
+        __func__,
+        len,
+        sf->id);
+    }
+  else if (padded
+           && 0 != ftruncate(sf->id, (off_t)( sf->bufoff + sf->buflen )))
+    {
+      _log_handleerr(errno);
+      write = false;
+    }
+
+  if (write && padded)
+    {
+      sf->bufsynced = sf->buflen;
+    }
+
+  if (blocks > 0)
+    {
+      /* Like LOGB_FD, whole blocks that couldn't be written are discarded. */
+      sf->buflen -= blocks;
+      sf->bufoff += blocks;
+      (void)memmove(sf->buf, sf->buf + blocks, sf->buflen);
+      sf->bufsynced = write && padded ? sf->buflen : 0;
+    }
+
+  return write;
+}
+
+bool
+_logfile_readtail(logfile *sf)
+{
+  size_t tail = (size_t)( sf->size % LOG_FDIRECTALIGN );
+
+  sf->bufoff    = sf->size - tail;
+  sf->buflen    = 0;
+  sf->bufsynced = 0;
+
+  if (0 == tail)
+    {
+      return true;
+    }
+
+  ssize_t read = LOG_INVALID;
+
+  do
+    {
+      read = pread(sf->id, sf->buf, LOG_FDIRECTALIGN, (off_t)sf->bufoff);
+    }
+  while (read < 0 && EINTR == errno);
+
+  if (read >= (ssize_t)tail)
+    {
+      sf->buflen    = tail;
+      sf->bufsynced = tail;
+      return true;
+    }
+
+  if (read < 0)
+    {
+      _log_handleerr(errno);
+    }
+
+  /* Rather than overwrite what couldn't be read, start the next block. */
+  sf->bufoff += LOG_FDIRECTALIGN;
+  sf->size    = sf->bufoff;
+  return false;
+}
+#endif /* ifndef _WIN32 */
+
+void
+_logfile_flush(logfile *sf)
+{
+  if (_log_validptr(sf->f))
+    {
+      _log_fflush(sf->f);
+    }
+#ifndef _WIN32
+  else if (LOG_INVALID != sf->id && !_logfile_writebuf(sf))
+    {
+      _logfile_fault(sf, sf->pending);
+    }
+#endif /* ifndef _WIN32 */
+
+#ifdef LOG_URING
+  atomic_store(&sf->deferred, false);
+  _logfile_uringfault(sf);
+#endif /* ifdef LOG_URING */
+
+  sf->pending = 0;
+}
+
+#ifdef LOG_URING
+void
+_logfile_uringfault(logfile *sf)
+{
+  int err = atomic_exchange(&sf->failed, 0);
+
+  if (0 != err)
+    {
+      /* Seen by this thread, as if the write had just failed here. */
+      _log_handleerr(err);
+      _logfile_fault(sf, atomic_exchange(&sf->lost, 0));
+    }
+}
+#endif /* ifdef LOG_URING */
+
+void
+_logfile_flushpolicy(logfile *sf)
+{
+#ifndef _WIN32
+  if (LOGB_DIRECT == sf->writer.type)
+    {
+      /* Padding the partial block, and truncating, each time would undo it. */
+      if (LOG_INVALID != sf->id && !_logfile_writeblocks(sf, false))
+        {
+          _logfile_fault(sf, sf->pending);
+        }
+
+      sf->pending = 0;
+      return;
+    }
+#endif /* ifndef _WIN32 */
+
+  _logfile_flush(sf);
+}
+
+bool
+_logfile_admit(logfile *sf)
+{
+#ifdef LOG_URING
+  _logfile_uringfault(sf);
+#endif /* ifdef LOG_URING */
+
+  if (0 == sf->fault.failures)
+    {
+      return true;
+    }
+
+  if (_log_getmsec() < sf->fault.retryat)
+    {
+      /* Dropped without a system call, until it's time to try again. */
+      sf->fault.dropped++;
+      _log_handleerr(sf->fault.err);
+      return false;
+    }
+
+  struct stat st = { 0 };
+
+  if (ENOSPC == sf->fault.err && !sf->fault.rolled
+      && 0 == fstat(sf->id, &st) && S_ISREG(st.st_mode))
+    {
+      /* Once; the archives' retention policy may free up some space. */
+      bool deferred    = false;
+      sf->fault.rolled = true;
+
+      if (_logfile_roll(sf, &deferred))
+        {
+          _log_selflog("%s: rolled '%s' to make space\n", __func__, sf->path);
+        }
+    }
+
+  /* The line that says what was dropped is the first thing tried. */
+  logchar_t msg[LOG_MAXMESSAGE] = { 0 };
+  (void)snprintf(msg, LOG_MAXMESSAGE, LOG_FHRESUMED,
+                 (unsigned long long)sf->fault.dropped, sf->fault.err);
+
+  if (!_logfile_writeheader(sf, msg))
+    {
+      _logfile_fault(sf, 1);
+      return false;
+    }
+
+  _log_selflog("%s: resumed writing to '%s'; %llu message(s) dropped\n",
+               __func__, sf->path, (unsigned long long)sf->fault.dropped);
+  (void)memset(&sf->fault, 0, sizeof ( logfault ));
+  return true;
+}
+
+void
+_logfile_fault(logfile *sf, uint64_t dropped)
+{
+  int err       = _log_getoserror();
+  uint32_t wait = LOG_FRETRYMIN;
+
+  for (uint32_t n = 0; n < sf->fault.failures && wait < LOG_FRETRYMAX; n++)
+    {
+      wait *= 2;
+    }
+
+  if (wait > LOG_FRETRYMAX)
+    {
+      wait = LOG_FRETRYMAX;
+    }
+
+  if (0 == sf->fault.failures)
+    {
+      _log_selflog("%s: suspending writes to '%s' (error %d)\n",
+                   __func__, sf->path, err);
+    }
+
+  sf->fault.failures++;
+  sf->fault.retryat  = _log_getmsec() + wait;
+  sf->fault.dropped += dropped;
+  sf->fault.err      = 0 != err ? err : EIO;
+}
+
+bool
+_logfile_sync(logfile *sf, bool unlock)
+{
+  uint64_t from   = sf->sync.synced;
+  uint64_t target = sf->sync.queued;
+  int fd          = sf->id;
+
+#ifndef LOG_NO_ASYNC
+  /* A duplicate is synced, so that the file can be rolled meanwhile. */
+  if (unlock && LOG_INVALID != ( fd = dup(sf->id) ))
+    {
+      sf->sync.syncing = true;
+      (void)_logmutex_unlock(&sf->mutex);
+    }
+  else
+    {
+      unlock = false;
+      fd     = sf->id;
+    }
+#else  /* ifndef LOG_NO_ASYNC */
+  (void)unlock;
+#endif /* ifndef LOG_NO_ASYNC */
+
+  bool sync = _log_fdsync(fd);
+
+#ifndef LOG_NO_ASYNC
+  if (unlock)
+    {
+      (void)close(fd);
+      (void)_logmutex_lock(&sf->mutex);
+      sf->sync.syncing = false;
+    }
+#endif /* ifndef LOG_NO_ASYNC */
+
+  if (!sync)
+    {
+      sf->sync.failfrom = from;
+      sf->sync.failto   = target;
+      _log_selflog("%s: failed to sync %d\n", __func__, sf->id);
+    }
+
+  /* The file may have been closed, and synced, in the meantime. */
+  if (target > sf->sync.synced)
+    {
+      sf->sync.synced = target;
+    }
+
+#ifndef LOG_NO_ASYNC
+  (void)_logcond_broadcast(&sf->sync.cond);
+#endif /* ifndef LOG_NO_ASYNC */
+
+  return sync;
+}
+
+bool
+_logfile_commit(logfile *sf)
+{
+  uint64_t ticket = sf->sync.queued;
+
+  while (sf->sync.synced < ticket)
+    {
+#ifndef LOG_NO_ASYNC
+      if (sf->sync.syncing)
+        {
+          /* If the sync in progress doesn't cover ticket, the next one will. */
+          if (!_logcond_wait(&sf->sync.cond, &sf->mutex))
+            {
+              return false;
+            }
+
+          continue;
+        }
+#endif /* ifndef LOG_NO_ASYNC */
+
+      (void)_logfile_sync(sf, true);
+    }
+
+  return ticket <= sf->sync.failfrom || ticket > sf->sync.failto;
+}
+
+bool
+_logfile_setwriter(logfile *sf, const logwriter *writer)
+{
+#ifdef _WIN32
+  if (LOGB_STDIO != writer->type)
+    {
+      _log_handleerr(ENOTSUP);
+      return false;
+    }
+#endif /* ifdef _WIN32 */
+
+  logwriter next = *writer;
+
+#ifdef LOG_URING
+  if (LOGB_URING == next.type && !_log_uring_start())
+#else  /* ifdef LOG_URING */
+  if (LOGB_URING == next.type)
+#endif /* ifdef LOG_URING */
+    {
+      _log_selflog("%s: io_uring unavailable; using LOGB_FD\n", __func__);
+      next.type = LOGB_FD;
+    }
+
+  if (LOGB_FD != next.type && LOGB_URING != next.type
+      && LOGB_DIRECT != next.type)
+    {
+      next.bufsize = 0;
+    }
+  else if (0 == next.bufsize)
+    {
+      next.bufsize = LOG_FBUFSIZE;
+    }
+
+  if (LOGB_DIRECT == next.type)
+    {
+      next.bufsize = ( next.bufsize + LOG_FDIRECTALIGN - 1 )
+                     / LOG_FDIRECTALIGN * LOG_FDIRECTALIGN;
+    }
+
+  _logfile_flush(sf);
+
+#ifdef LOG_URING
+  /* Its buffers are about to be replaced. */
+  _log_uring_wait(sf);
+#endif /* ifdef LOG_URING */
+
+  if (next.type == sf->writer.type && next.bufsize == sf->writer.bufsize)
+    {
+      return true;
+    }
+
+  logchar_t *buf      = NULL;
+  logchar_t *inflight = NULL;
+
+  if (0 != next.bufsize)
+    {
+#ifndef _WIN32
+      if (LOGB_DIRECT == next.type)
+        {
+          /* O_DIRECT transfers need aligned memory, too. */
+          void *aligned = NULL;
+          int alloc     = posix_memalign(&aligned, LOG_FDIRECTALIGN, next.bufsize);
+
+          errno = alloc;
+          buf   = (logchar_t *)aligned;
+        }
+      else
+#endif /* ifndef _WIN32 */
+        {
+          buf = (logchar_t *)malloc(next.bufsize);
+        }
+
+      if (LOGB_URING == next.type)
+        {
+          inflight = (logchar_t *)malloc(next.bufsize);
+        }
+
+      if (!_log_validptr(buf) || ( LOGB_URING == next.type && !_log_validptr(inflight)))
+        {
+          _log_handleerr(errno);
+          _log_safefree(buf);
+          _log_safefree(inflight);
+          return false;
+        }
+    }
+
+  logwriter prev     = sf->writer;
+  logchar_t *prevbuf = sf->buf;
+  size_t prevlen     = sf->buflen;
+  logflush prevflush = sf->flush;
+
+  sf->writer = next;
+  sf->buf    = buf;
+
+  /* Blocks are buffered, rather than written for each message. */
+  if (LOGB_DIRECT == next.type && 1 == sf->flush.count
+      && 0 == sf->flush.msec && LOGL_NONE == sf->flush.levels)
+    {
+      sf->flush.count = 0;
+      sf->flush.msec  = LOG_FDIRECTMSEC;
+    }
+  else if (LOGB_DIRECT == prev.type && LOGB_DIRECT != next.type
+           && 0 == sf->flush.count && LOG_FDIRECTMSEC == sf->flush.msec
+           && LOGL_NONE == sf->flush.levels)
+    {
+      sf->flush.count = 1;
+      sf->flush.msec  = 0;
+    }
+
+  if (next.type != prev.type)
+    {
+      /* What's left (a LOGB_DIRECT file's partial block) is in the file. */
+      sf->buflen = 0;
+
+      if (!_logfile_open(sf))
+        {
+          sf->writer = prev;
+          sf->buf    = prevbuf;
+          sf->buflen = prevlen;
+          sf->flush  = prevflush;
+          _log_safefree(buf);
+          _log_safefree(inflight);
+          return false;
+        }
+    }
+  else if (0 != sf->buflen)
+    {
+      (void)memcpy(sf->buf, prevbuf, sf->buflen);
+    }
+
+  _log_safefree(prevbuf);
+#ifdef LOG_URING
+  _log_safefree(sf->inflight);
+  sf->inflight = inflight;
+#else  /* ifdef LOG_URING */
+  _log_safefree(inflight);
+#endif /* ifdef LOG_URING */
+  return true;
+}
+
+bool
+_logfile_writeheader(logfile *sf, const logchar_t *msg)
+{
+  if (_logfile_validate(sf) && _log_validstr(msg))
+    {
+      time_t now;
+      bool gettime = _log_getlocaltime(&now, NULL);
+      assert(gettime);
+
+      if (gettime)
+        {
+          logchar_t timestamp[LOG_MAXTIME] = { 0 };
+          bool fmttime = _log_formattime(now, timestamp, LOG_FHTIMEFORMAT);
+          assert(fmttime);
+
+          if (fmttime)
+            {
+              logchar_t header[LOG_MAXOUTPUT] = { 0 };
+              int fmt = snprintf(header, LOG_MAXOUTPUT, LOG_FHFORMAT, msg, timestamp);
+
+              if (fmt < 0)
+                {
+                  _log_handleerr(errno);
+                  return false;
+                }
+
+              logiovec vec = {
+                0
+              };
+
+              _log_iovappend(&vec, header, _log_fmtlen(fmt, LOG_MAXOUTPUT));
+              return _logfile_write(sf, &vec);
+            }
+        }
+    }
+
+  return false;
+}
+
+bool
+_logfile_needsroll(logfile *sf)
+{
+  if (_logfile_validate(sf))
+    {
+#if LOG_FSIZESYNC > 0
+      /* Buffered output isn't in the file yet; check once it is. */
+      if (++sf->writes >= LOG_FSIZESYNC && 0 == sf->pending)
+        {
+          (void)_logfile_syncsize(sf);
+        }
+#endif /* if LOG_FSIZESYNC > 0 */
+
+      if (0 != sf->roll.size && sf->size >= sf->roll.size)
+        {
+          return true;
+        }
+
+      return 0 != sf->roll.interval && time(NULL) >= sf->rollat;
+    }
+
+  return false;
+}
+
+void
+_logfile_setrollat(logfile *sf)
+{
+  if (0 != sf->roll.interval)
+    {
+      time_t now = time(NULL);
+      sf->rollat = now - now % sf->roll.interval + sf->roll.interval;
+    }
+}
+
+size_t
+_logfile_maplen(const logfile *sf, uint64_t size, size_t extra)
+{
+  uint64_t len = LOG_FMAPSIZE;
+
+  if (0 != sf->roll.size && sf->roll.size > size
+      && sf->roll.size - size < len)
+    {
+      len = sf->roll.size - size;
+    }
+
+  /* Plus room for the message that crosses the roll size. */
+  return (size_t)( size + len ) + extra + LOG_MAXOUTPUT;
+}
+
+void
+_logfile_preallocate(logfile *sf)
+{
+#ifdef LOG_FALLOCATE
+  /* Plus room for the message that crosses the roll size. */
+  uint64_t end = sf->roll.size + LOG_MAXOUTPUT;
+
+  if (!sf->prealloc || 0 == sf->roll.size || sf->size >= end
+      || sf->allocated >= end || LOGB_MMAP == sf->writer.type
+      || LOGB_DIRECT == sf->writer.type)
+    {
+      return;
+    }
+
+  if (0 != fallocate(sf->id, FALLOC_FL_KEEP_SIZE, (off_t)sf->size,
+                     (off_t)( end - sf->size )))
+    {
+      /* Not supported by the file system, or out of space; no matter. */
+      _log_handleerr(errno);
+      _log_selflog("%s: failed to preallocate '%s'\n", __func__, sf->path);
+      return;
+    }
+
+  sf->allocated = end;
+#else  /* ifdef LOG_FALLOCATE */
+  (void)sf;
+#endif /* ifdef LOG_FALLOCATE */
+}
+
+void
+_logfile_release(logfile *sf)
+{
+#ifdef LOG_FALLOCATE
+  if (0 != sf->allocated)
+    {
+      /* Truncating a file to its own size frees the blocks past its end. */
+      struct stat st = { 0 };
+
+      if (0 != fstat(sf->id, &st) || 0 != ftruncate(sf->id, st.st_size))
+        {
+          _log_handleerr(errno);
+        }
+
+      sf->allocated = 0;
+    }
+#else  /* ifdef LOG_FALLOCATE */
+  (void)sf;
+#endif /* ifdef LOG_FALLOCATE */
+}
+
+bool
+_logfile_syncsize(logfile *sf)
+{
+  struct stat st = { 0 };
+
+  sf->writes = 0;
+
+  if (_log_validptr(sf->map))
+    {
+      return true; /* The file is as long as the mapping; size is the length. */
+    }
+
+  if (0 != fstat(sf->id, &st))
+    {
+      _log_handleerr(errno);
+      return false;
+    }
+
+  sf->size = (uint64_t)st.st_size;
+  return true;
+}
+
+bool
+_logfile_roll(logfile *sf, bool *deferred)
+{
+  if (_logfile_validate(sf) && _log_validptr(deferred))
+    {
+      *deferred = false;
+
+#ifndef LOG_NO_ASYNC
+      /*
+       * The replacement is opened under another name, and the background
+       * helper thread archives the file and renames the replacement.
+       */
+      if (!_log_worker_reserveroll())
+        {
+          *deferred = true;
+          return false;
+        }
+
+      logrolljob job = {
+        0
+      };
+
+      job.path     = strdup(sf->path);
+      job.tmppath  = (logchar_t *)calloc(LOG_MAXPATH, sizeof ( logchar_t ));
+      job.when     = time(NULL);
+      job.compress = sf->compress;
+
+      if (_log_validptr(job.path) && _log_validptr(job.tmppath))
+        {
+          int fmtpath = snprintf(job.tmppath, LOG_MAXPATH, LOG_FROLLTMPFORMAT,
+                                 sf->path, (long)_log_getpid(),
+                                 atomic_fetch_add(&log_sequence_counter, 1));
+
+          if (fmtpath < 0)
+            {
+              _log_handleerr(errno);
+            }
+
+          if (fmtpath >= 0 && _logfile_openpath(sf, job.tmppath))
+            {
+              _log_worker_roll(&job);
+              return true;
+            }
+        }
+
+      _log_worker_cancelroll();
+      _log_safefree(job.path);
+      _log_safefree(job.tmppath);
+      return false;
+#else  /* ifndef LOG_NO_ASYNC */
+      logchar_t *newpath = NULL;
+
+      bool r = _log_archivepath(sf->path, time(NULL), &newpath)
+               && _logfile_archive(sf, newpath);
+
+      if (r)
+        {
+          logchar_t *zpath     = NULL;
+          logarchives expired = {
+            0
+          };
+
+          if (sf->compress && _log_compressfile(newpath, &zpath))
+            {
+              _log_safefree(newpath);
+              newpath = zpath;
+            }
+
+          _logfile_archived(sf, newpath, &expired);
+          _log_removearchives(&expired);
+        }
+
+      _log_safefree(newpath);
+      return r;
+#endif /* ifndef LOG_NO_ASYNC */
+    }
+
+  return false;
+}
+
+bool
+_log_archivepath(const logchar_t *path, time_t when, logchar_t **newpath)
+{
+  if (_log_validstr(path) && _log_validptr(newpath))
+    {
+      bool r          = false;
+      logchar_t *name = NULL;
+      logchar_t *ext  = NULL;
+
+      *newpath = NULL;
+
+      bool split = _log_splitpath(path, &name, &ext);
+      assert(split);
+
+      if (split)
+        {
+          logchar_t timestamp[LOG_MAXTIME] = {
+            0
+          };
+          bool fmttime = _log_formattime(when, timestamp, LOG_FNAMETIMEFORMAT);
+          assert(fmttime);
+
+          if (fmttime)
+            {
+              *newpath = (logchar_t *)calloc(LOG_MAXPATH, sizeof ( logchar_t ));
+
+              if (_log_validptr(*newpath))
+                {
+                  int fmtpath
+                    = snprintf(
+                        *newpath,
+                        LOG_MAXPATH,
+                        LOG_FNAMEFORMAT,
+                        name,
+                        timestamp,
+                        atomic_fetch_add(&log_sequence_counter, 1),
+                        _log_validstrnofail(ext) ? ext : "");
+
+                  if (fmtpath < 0)
+                    {
+                      _log_handleerr(errno);
+                    }
+
+                  r = fmtpath >= 0;
+                }
+            }
+        }
+
+      _log_safefree(name);
+      _log_safefree(ext);
+
+      if (!r)
+        {
+          _log_safefree(*newpath);
+          *newpath = NULL;
+        }
+
+      return r;
+    }
+
+  return false;
+}
+
+bool
+_logfile_archive(logfile *sf, const logchar_t *newpath)
+{
+  if (_logfile_validate(sf) && _log_validstr(newpath))
+    {
+#ifdef _WIN32
+      /* Need to close the old file first on windows. */
+      _logfile_close(sf);
+#endif /* ifdef _WIN32 */
+
+      if (access(newpath, F_OK) == 0)
+        {
+          _log_selflog(
+            "%s: '%s' exists!\n",
+            __func__,
+            newpath);
+          return false;
+        }
+
+      if (0 != rename(sf->path, newpath))
+        {
+          _log_handleerr(errno);
+          return false;
+        }
+
+      if (_logfile_open(sf))
+        {
+          _log_selflog(
+            "%s: archived '%s' -> '%s'\n",
+            __func__,
+            sf->path,
+            newpath);
+          return true;
+        }
+    }
+
+  return false;
+}
+
+#ifndef LOG_NO_ASYNC
+bool
+_log_archiveroll(const logrolljob *job, logchar_t **newpath)
+{
+  if (_log_validptr(job) && _log_archivepath(job->path, job->when, newpath))
+    {
+      /* Linked, so that there's always a file at path. */
+      if (0 != link(job->path, *newpath))
+        {
+          int err = errno;
+
+          if (EEXIST == err || 0 == access(*newpath, F_OK)
+              || 0 != rename(job->path, *newpath))
+            {
+              /* Leave the replacement where it is, rather than lose path. */
+              _log_handleerr(EEXIST == err ? err : errno);
+              _log_selflog(
+                "%s: failed to archive '%s' -> '%s'\n",
+                __func__,
+                job->path,
+                *newpath);
+              return false;
+            }
+        }
+
+      if (0 != rename(job->tmppath, job->path))
+        {
+          _log_handleerr(errno);
+          return false;
+        }
+
+      _log_selflog(
+        "%s: archived '%s' -> '%s'\n",
+        __func__,
+        job->path,
+        *newpath);
+      return true;
+    }
+
+  return false;
+}
+#endif /* ifndef LOG_NO_ASYNC */
+
+bool
+_log_splitpath(const logchar_t *path, logchar_t **name, logchar_t **ext)
+{
+  if (name)
+    {
+      *name = NULL;
+    }
+
+  if (ext)
+    {
+      *ext = NULL;
+    }
+
+  if (_log_validstr(path) && _log_validptr(name) && _log_validptr(ext))
+    {
+      const logchar_t *lastfullstop = strrchr(path, '.');
+
+      if (lastfullstop)
+        {
+          uintptr_t namesize = lastfullstop - path;
+          assert(namesize < LOG_MAXPATH);
+
+          if (namesize < LOG_MAXPATH)
+            {
+              *name = (logchar_t *)calloc(namesize + 1, sizeof ( logchar_t ));
+              if (*name == NULL)
+                {
+                  return false;
+                }
+              (void)strncpy(*name, path, namesize);
+            }
+
+          *ext = strdup(lastfullstop);
+        }
+      else
+        {
+          *name = strdup(path);
+        }
+
+      return _log_validstr(*name) && ( !lastfullstop || _log_validstr(*ext));
+    }
+
+  return false;
+}
+
+bool
+_logfile_retains(const logfile *sf)
+{
+  return 0 != sf->retain.count || 0 != sf->retain.bytes || 0 != sf->retain.age;
+}
+
+void
+_logfile_queueprune(logfile *sf)
+{
+#ifndef LOG_NO_ASYNC
+  if (!_log_worker_reserveroll())
+    {
+      _log_selflog(
+        "%s: not pruning '%s' until it's rolled\n",
+        __func__,
+        sf->path);
+      return;
+    }
+
+  logrolljob job = {
+    0
+  };
+
+  job.path = strdup(sf->path);
+
+  if (_log_validptr(job.path))
+    {
+      _log_worker_roll(&job);
+    }
+  else
+    {
+      _log_worker_cancelroll();
+    }
+#else  /* ifndef LOG_NO_ASYNC */
+  logarchives expired = {
+    0
+  };
+
+  _logfile_archived(sf, NULL, &expired);
+  _log_removearchives(&expired);
+#endif /* ifndef LOG_NO_ASYNC */
+}
+
+void
+_logfile_archived(logfile *sf, const logchar_t *archive, logarchives *expired)
+{
+  if (!sf->archives.indexed)
+    {
+      /* Finds archive as well. */
+      (void)_log_findarchives(sf->path, &sf->archives);
+      sf->archives.indexed = true;
+    }
+  else if (_log_validstrnofail(archive) && !_logarchives_has(&sf->archives, archive))
+    {
+      struct stat st  = { 0 };
+      logchar_t *copy = strdup(archive);
+
+      if (0 != stat(archive, &st) || !_log_validptr(copy)
+          || !_logarchives_add(&sf->archives, copy, (uint64_t)st.st_size,
+                               st.st_mtime))
+        {
+          _log_handleerr(errno);
+          _log_safefree(copy);
+        }
+    }
+
+  _logfile_expire(sf, time(NULL), expired);
+}
+
+void
+_logfile_expire(logfile *sf, time_t now, logarchives *expired)
+{
+  logarchives *a = &sf->archives;
+  uint64_t bytes = a->bytes;
+  size_t n       = 0;
+
+  /* Oldest first, until what's left is within the policy. */
+  while (n < a->count)
+    {
+      size_t left = a->count - n;
+
+      if (!( 0 != sf->retain.count && left > sf->retain.count )
+          && !( 0 != sf->retain.bytes && bytes > sf->retain.bytes )
+          && !( 0 != sf->retain.age
+                && a->items[n].mtime + (time_t)sf->retain.age <= now ))
+        {
+          break;
+        }
+
+      if (!_logarchives_add(expired, a->items[n].path, a->items[n].size,
+                            a->items[n].mtime))
+        {
+          break;
+        }
+
+      bytes -= a->items[n].size;
+      n++;
+    }
+
+  if (n > 0)
+    {
+      (void)memmove(&a->items[0], &a->items[n], sizeof ( a->items[0] ) * ( a->count - n ));
+      a->count -= n;
+      a->bytes  = bytes;
+    }
+}
+
+bool
+_logarchives_add(logarchives *a, logchar_t *path, uint64_t size, time_t mtime)
+{
+  if (a->count == a->size)
+    {
+      size_t grown      = 0 == a->size ? LOG_FCACHEINIT : a->size * 2;
+      logarchive *items = (logarchive *)realloc(a->items, grown * sizeof ( logarchive ));
+
+      if (!items)
+        {
+          _log_handleerr(errno);
+          return false;
+        }
+
+      a->items = items;
+      a->size  = grown;
+    }
+
+  a->items[a->count].path  = path;
+  a->items[a->count].size  = size;
+  a->items[a->count].mtime = mtime;
+  a->count++;
+  a->bytes += size;
+  return true;
+}
+
+bool
+_logarchives_has(const logarchives *a, const logchar_t *path)
+{
+  /* Newest last, and those are the likeliest. */
+  for (size_t n = a->count; n > 0; n--)
+    {
+      if (0 == strcmp(a->items[n - 1].path, path))
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
+void
+_logarchives_free(logarchives *a)
+{
+  for (size_t n = 0; n < a->count; n++)
+    {
+      _log_safefree(a->items[n].path);
+    }
+
+  _log_safefree(a->items);
+  (void)memset(a, 0, sizeof ( logarchives ));
+}
+
+int
+_logarchives_compare(const void *lhs, const void *rhs)
+{
+  const logarchive *l = (const logarchive *)lhs;
+  const logarchive *r = (const logarchive *)rhs;
+
+  if (l->mtime != r->mtime)
+    {
+      return l->mtime < r->mtime ? -1 : 1;
+    }
+
+  /* Names sort by time stamp, then sequence number. */
+  return strcmp(l->path, r->path);
+}
+
+void
+_log_removearchives(logarchives *expired)
+{
+  for (size_t n = 0; n < expired->count; n++)
+    {
+      if (0 != remove(expired->items[n].path))
+        {
+          _log_handleerr(errno);
+        }
+      else
+        {
+          _log_selflog(
+            "%s: removed '%s'\n",
+            __func__,
+            expired->items[n].path);
+        }
+    }
+
+  _logarchives_free(expired);
+}
+
+bool
+_log_isarchive(const logchar_t *name, const logchar_t *base, const logchar_t *ext)
+{
+  size_t namelen = strlen(name);
+  size_t baselen = strlen(base);
+  size_t extlen  = strlen(ext);
+  size_t zlen    = strlen(LOG_FCOMPRESSEXT);
+
+  if (namelen <= baselen + 1 || 0 != strncmp(name, base, baselen)
+      || '-' != name[baselen])
+    {
+      return false;
+    }
+
+  /* What's left is "<time stamp>-<sequence><ext>[LOG_FCOMPRESSEXT]". */
+  const logchar_t *stamp = name + baselen + 1;
+  size_t len             = namelen - baselen - 1;
+
+  if (len > zlen && 0 == strcmp(stamp + len - zlen, LOG_FCOMPRESSEXT))
+    {
+      len -= zlen;
+    }
+
+  if (len <= extlen || 0 != strncmp(stamp + len - extlen, ext, extlen))
+    {
+      return false;
+    }
+
+  len -= extlen;
+
+  for (size_t n = 0; n < len; n++)
+    {
+      if (!isdigit((unsigned char)stamp[n]) && '-' != stamp[n])
+        {
+          return false;
+        }
+    }
+
+  return isdigit((unsigned char)stamp[len - 1]);
+}
+
+bool
+_log_findarchives(const logchar_t *path, logarchives *found)
+{
+  const logchar_t *file = strrchr(path, '/');
+#ifdef _WIN32
+  const logchar_t *bslash = strrchr(path, '\\');
+
+  if (bslash && ( !file || bslash > file ))
+    {
+      file = bslash;
+    }
+#endif /* ifdef _WIN32 */
+
+  /* Archives are named as in _log_archivepath, relative to the same place. */
+  size_t dirlen = file ? (size_t)( file - path ) + 1 : 0;
+  file          = file ? file + 1 : path;
+
+  logchar_t *base            = NULL;
+  logchar_t *ext             = NULL;
+  logchar_t dir[LOG_MAXPATH] = { 0 };
+
+  if (dirlen >= LOG_MAXPATH || !_log_splitpath(file, &base, &ext))
+    {
+      _log_safefree(base);
+      _log_safefree(ext);
+      return false;
+    }
+
+  (void)strncpy(dir, path, dirlen);
+
+  bool r = true;
+
+#ifndef _WIN32
+  DIR *d = opendir(0 == dirlen ? "." : dir);
+
+  if (!d)
+    {
+      _log_handleerr(errno);
+      r = false;
+    }
+
+  for (struct dirent *e = d ? readdir(d) : NULL; e; e = readdir(d))
+    {
+      if (!_log_isarchive(e->d_name, base, _log_validstrnofail(ext) ? ext : ""))
+        {
+          continue;
+        }
+
+      struct stat st     = { 0 };
+      logchar_t *archive = (logchar_t *)calloc(LOG_MAXPATH, sizeof ( logchar_t ));
+
+      if (_log_validptr(archive)
+          && snprintf(archive, LOG_MAXPATH, "%s%s", dir, e->d_name) > 0
+          && 0 == stat(archive, &st) && S_ISREG(st.st_mode)
+          && _logarchives_add(found, archive, (uint64_t)st.st_size, st.st_mtime))
+        {
+          continue;
+        }
+
+      _log_safefree(archive);
+    }
+
+  if (d)
+    {
+      (void)closedir(d);
+    }
+#else  /* ifndef _WIN32 */
+  logchar_t search[LOG_MAXPATH] = { 0 };
+  WIN32_FIND_DATAA finddata     = { 0 };
+
+  (void)snprintf(search, LOG_MAXPATH, "%s*", 0 == dirlen ? ".\\" : dir);
+
+  HANDLE enumerator = FindFirstFileA(search, &finddata);
+
+  if (INVALID_HANDLE_VALUE == enumerator)
+    {
+      _log_handleerr(GetLastError());
+      r = false;
+    }
+  else
+    {
+      do
+        {
+          if (( finddata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+              || !_log_isarchive(finddata.cFileName, base,
+                                 _log_validstrnofail(ext) ? ext : ""))
+            {
+              continue;
+            }
+
+          /* FILETIME counts 100 ns intervals since 1601. */
+          ULARGE_INTEGER t;
+          t.LowPart  = finddata.ftLastWriteTime.dwLowDateTime;
+          t.HighPart = finddata.ftLastWriteTime.dwHighDateTime;
+
+          logchar_t *archive = (logchar_t *)calloc(LOG_MAXPATH, sizeof ( logchar_t ));
+
+          if (!_log_validptr(archive)
+              || snprintf(archive, LOG_MAXPATH, "%s%s", dir, finddata.cFileName) <= 0
+              || !_logarchives_add(found, archive,
+                                   ( (uint64_t)finddata.nFileSizeHigh << 32 )
+                                   | finddata.nFileSizeLow,
+                                   (time_t)( ( t.QuadPart - 116444736000000000ULL )
+                                             / 10000000ULL )))
+            {
+              _log_safefree(archive);
+            }
+        }
+      while (FindNextFileA(enumerator, &finddata) > 0);
+
+      (void)FindClose(enumerator);
+    }
+#endif /* ifndef _WIN32 */
+
+  if (found->count > 1)
+    {
+      qsort(found->items, found->count, sizeof ( logarchive ), _logarchives_compare);
+    }
+
+  _log_safefree(base);
+  _log_safefree(ext);
+  return r;
+}
+
+#ifndef LOG_NO_ASYNC
+void
+_log_fcache_archived(const logchar_t *path, const logchar_t *archive)
+{
+  logarchives found = {
+    0
+  };
+  logarchives expired = {
+    0
+  };
+  logfcache *sfc = _log_locksection_shared(_LOGM_FILECACHE);
+
+  if (!sfc)
+    {
+      return;
+    }
+
+  logfile *sf = _log_fcache_findpath(sfc, path);
+
+  if (sf && !sf->archives.indexed)
+    {
+      /* Not while logging waits on a directory search. */
+      (void)_log_unlocksection_shared(_LOGM_FILECACHE);
+      (void)_log_findarchives(path, &found);
+      found.indexed = true;
+
+      sfc = _log_locksection_shared(_LOGM_FILECACHE);
+
+      if (!sfc)
+        {
+          _logarchives_free(&found);
+          return;
+        }
+
+      sf = _log_fcache_findpath(sfc, path);
+    }
+
+  /* The section is only held shared; the file's mutex guards its archives. */
+  if (sf && _logmutex_lock(&sf->mutex))
+    {
+      if (!sf->archives.indexed && found.indexed)
+        {
+          sf->archives = found;
+          archive      = NULL; /* Already found. */
+          (void)memset(&found, 0, sizeof ( found ));
+        }
+
+      _logfile_archived(sf, archive, &expired);
+      (void)_logmutex_unlock(&sf->mutex);
+    }
+
+  (void)_log_unlocksection_shared(_LOGM_FILECACHE);
+
+  _log_removearchives(&expired);
+  _logarchives_free(&found);
+}
+#endif /* ifndef LOG_NO_ASYNC */
+
+void
+_logfile_destroy(logfile *sf)
 {
   if (sf)
     {
-      _logfile_close (sf);
-      _log_safefree  (sf->path);
-      _log_safefree  (sf);
+      _logfile_close     (sf);
+#ifndef LOG_NO_ASYNC
+      _logcond_destroy   (&sf->sync.cond);
+#endif /* ifndef LOG_NO_ASYNC */
+      _logmutex_destroy  (&sf->mutex);
+      _logarchives_free  (&sf->archives);
+      _log_safefree      (sf->buf);
+#ifdef LOG_URING
+      _log_safefree      (sf->inflight);
+#endif /* ifdef LOG_URING */
+      _log_safefree      (sf->path);
+      _log_safefree      (sf);
     }
 }
 
 bool
 _logfile_validate(logfile *sf)
 {
-  return _log_validptr(sf) && _log_validfid(sf->id) && _log_validptr(sf->f)
+  return _log_validptr(sf) && _log_validfid(sf->id)
+         && ( _log_validptr(sf->f) || LOGB_STDIO != sf->writer.type )
          && _log_validstr(sf->path);
 }
 
-void
+bool
 _logfile_update(logfile *sf, log_update_data *data)
 {
   if (_logfile_validate(sf) && _log_validupdatedata(data))
@@ -472,7 +2037,60 @@ _logfile_update(logfile *sf, log_update_data *data)
         {
           sf->opts = *data->opts;
         }
+
+      if (data->flush && _log_validlevels(data->flush->levels))
+        {
+          /* Don't leave anything buffered behind an unbuffered write. */
+          _logfile_flushpolicy(sf);
+          sf->flush = *data->flush;
+        }
+
+      if (data->prealloc)
+        {
+          sf->prealloc = *data->prealloc;
+
+          if (!sf->prealloc)
+            {
+              _logfile_release(sf);
+            }
+        }
+
+      if (data->roll)
+        {
+          sf->roll = *data->roll;
+          _logfile_setrollat(sf);
+        }
+
+      if (data->prealloc || data->roll)
+        {
+          _logfile_preallocate(sf);
+        }
+
+      if (data->compress)
+        {
+          sf->compress = *data->compress;
+        }
+
+      if (data->retain)
+        {
+          sf->retain = *data->retain;
+          _logfile_queueprune(sf);
+        }
+
+      if (data->sync)
+        {
+          sf->sync.levels = *data->sync;
+        }
+
+      if (data->writer)
+        {
+          return _logfile_setwriter(sf, data->writer);
+        }
+
+      return true;
     }
+
+  return false;
 }
 
 logfileid_t
@@ -488,10 +2106,7 @@ _log_fcache_add(logfcache *sfc, const logchar_t *path, log_levels levels,
           return NULL;
         }
 
-      logfile *existing
-        = _log_fcache_find(sfc, (const void *)path, _log_fcache_pred_path);
-
-      if (NULL != existing)
+      if (NULL != _log_fcache_findpath(sfc, path))
         {
           _log_seterror(_LOG_E_DUPFILE);
           _log_selflog(
@@ -501,141 +2116,481 @@ _log_fcache_add(logfcache *sfc, const logchar_t *path, log_levels levels,
           return NULL;
         }
 
+      if (sfc->count == sfc->size && !_log_fcache_grow(sfc))
+        {
+          return NULL;
+        }
+
       logfile *sf = _logfile_create(path, levels, opts);
 
       if (_logfile_validate(sf))
         {
-          sfc->files[sfc->count++] = sf;
+          sfc->files[sfc->count] = sf;
+          _log_fcache_index(sfc, sfc->count++);
 
-          if (sf == NULL)
+          if (!_log_bittest(sf->opts, LOGO_NOHDR))
             {
-              return NULL;
+              (void)_logfile_writeheader(sf, LOG_FHBEGIN);
             }
 
-          if (!_log_bittest(sf->opts, LOGO_NOHDR))
-            {
-              (void)_logfile_writeheader(sf, LOG_FHBEGIN);
-            }
+          /* Finds archives left from earlier, before a policy needs them. */
+          _logfile_queueprune(sf);
+          return &sf->id;
+        }
+    }
+
+  return NULL;
+}
+
+bool
+_log_fcache_update(logfcache *sfc, logfileid_t id, log_update_data *data)
+{
+  if (_log_validptr(sfc) && _log_validptr(id) && _log_validfid(*id)
+      && _log_validupdatedata(data))
+    {
+      logfile *found = _log_fcache_findid(sfc, id);
+
+      if (!found)
+        {
+          _log_seterror(_LOG_E_NOFILE);
+          return false;
+        }
+
+      return _logfile_update(found, data);
+    }
+
+  return false;
+}
+
+bool
+_log_fcache_rem(logfcache *sfc, logfileid_t id)
+{
+  if (_log_validptr(sfc) && _log_validptr(id) && _log_validfid(*id))
+    {
+      bool found    = false;
+      size_t bucket = _log_fcache_bucket(sfc, false, id, &found);
+
+      if (!found)
+        {
+          _log_seterror(_LOG_E_NOFILE);
+          return false;
+        }
+
+      size_t n    = sfc->byid[bucket] - 1;
+      size_t last = sfc->count - 1;
+      logfile *sf = sfc->files[n];
+
+      assert(_logfile_validate(sf));
+      _log_fcache_unindex(sfc, false, bucket);
+      _log_fcache_unindex(sfc, true, _log_fcache_bucket(sfc, true, sf->path, &found));
+
+      if (n != last)
+        {
+          /* Fill the hole with the last file, so the table stays dense. */
+          logfile *moved = sfc->files[last];
+
+          sfc->files[n] = moved;
+          sfc->bypath[_log_fcache_bucket(sfc, true, moved->path, &found)] = (uint32_t)n + 1;
+          sfc->byid[_log_fcache_bucket(sfc, false, &moved->id, &found)]   = (uint32_t)n + 1;
+        }
+
+      sfc->files[last] = NULL;
+      sfc->count--;
+
+      _logfile_destroy(sf);
+      return true;
+    }
+
+  return false;
+}
+
+bool
+_log_fcache_pred_path(const void *match, logfile *iter)
+{
+  const logchar_t *path = (const logchar_t *)match;
+
+#ifndef _WIN32
+  return 0 == strncmp(path, iter->path, LOG_MAXPATH);
+#else /* ifndef _WIN32 */
+  /* paths/file names are not case sensitive on windows. */
+  return 0 == _strnicmp(path, iter->path, LOG_MAXPATH);
+#endif /* ifndef _WIN32 */
+}
+
+size_t
+_log_fcache_hash(bool bypath, const void *key)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  if (bypath)
+    {
+      /* FNV-1a, over the characters compared by _log_fcache_pred_path. */
+      const logchar_t *path = (const logchar_t *)key;
+
+      for (size_t n = 0; n < LOG_MAXPATH && '\0' != path[n]; n++)
+        {
+#ifndef _WIN32
+          h ^= (uint8_t)path[n];
+#else /* ifndef _WIN32 */
+          h ^= (uint8_t)tolower((unsigned char)path[n]);
+#endif /* ifndef _WIN32 */
+          h *= 1099511628211ULL;
+        }
+    }
+  else
+    {
+      h  = (uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ULL;
+      h ^= h >> 32;
+    }
+
+  return (size_t)h;
+}
+
+size_t
+_log_fcache_bucket(const logfcache *sfc, bool bypath, const void *key,
+                   bool *found)
+{
+  const uint32_t *index = bypath ? sfc->bypath : sfc->byid;
+  size_t n              = _log_fcache_hash(bypath, key) & sfc->mask;
+
+  *found = false;
+
+  if (!index)
+    {
+      return 0;
+    }
+
+  for (; 0 != index[n]; n = ( n + 1 ) & sfc->mask)
+    {
+      logfile *sf = sfc->files[index[n] - 1];
+
+      if (bypath ? _log_fcache_pred_path(key, sf) : (logfileid_t)key == &sf->id)
+        {
+          *found = true;
+          break;
+        }
+    }
+
+  return n;
+}
+
+void
+_log_fcache_index(logfcache *sfc, size_t n)
+{
+  bool found = false;
+
+  sfc->bypath[_log_fcache_bucket(sfc, true, sfc->files[n]->path, &found)] = (uint32_t)n + 1;
+  sfc->byid[_log_fcache_bucket(sfc, false, &sfc->files[n]->id, &found)]   = (uint32_t)n + 1;
+}
+
+void
+_log_fcache_unindex(logfcache *sfc, bool bypath, size_t bucket)
+{
+  uint32_t *index = bypath ? sfc->bypath : sfc->byid;
+  size_t hole     = bucket;
+
+  /* Linear probing: shift back the entries that probed past the hole. */
+  for (size_t n = ( hole + 1 ) & sfc->mask; 0 != index[n]; n = ( n + 1 ) & sfc->mask)
+    {
+      logfile *sf = sfc->files[index[n] - 1];
+      size_t home = _log_fcache_hash(bypath, bypath ? (const void *)sf->path
+                                                    : (const void *)&sf->id)
+                    & sfc->mask;
+
+      if ((( n - home ) & sfc->mask ) >= (( n - hole ) & sfc->mask ))
+        {
+          index[hole] = index[n];
+          hole        = n;
+        }
+    }
+
+  index[hole] = 0;
+}
+
+bool
+_log_fcache_grow(logfcache *sfc)
+{
+  size_t size    = 0 == sfc->size ? LOG_FCACHEINIT : sfc->size * 2;
+  size_t buckets = 1;
+
+  if (size > LOG_MAXFILES)
+    {
+      size = LOG_MAXFILES;
+    }
+
+  /* Keep the indexes at most half full. */
+  while (buckets < size * 2)
+    {
+      buckets <<= 1;
+    }
+
+  logfile **files  = (logfile **)realloc(sfc->files, size * sizeof ( logfile * ));
+  uint32_t *bypath = (uint32_t *)calloc(buckets, sizeof ( uint32_t ));
+  uint32_t *byid   = (uint32_t *)calloc(buckets, sizeof ( uint32_t ));
+
+  if (files)
+    {
+      sfc->files = files;
+    }
+
+  /* Each route may have every file, each in a group of its own. */
+  logfile **routefiles = (logfile **)realloc(sfc->routefiles,
+                           LOG_NUMLEVELS * size * sizeof ( logfile * ));
+
+  if (routefiles)
+    {
+      sfc->routefiles = routefiles;
+    }
+
+  logroutegroup *routegroups = (logroutegroup *)realloc(sfc->routegroups,
+                                 LOG_NUMLEVELS * size * sizeof ( logroutegroup ));
+
+  if (routegroups)
+    {
+      sfc->routegroups = routegroups;
+    }
+
+  /* The routes refer to the old storage until they're rebuilt. */
+  (void)memset(sfc->route, 0, sizeof ( sfc->route ));
+
+  if (!files || !bypath || !byid || !routefiles || !routegroups)
+    {
+      _log_handleerr(errno);
+      _log_safefree(bypath);
+      _log_safefree(byid);
+      return false;
+    }
+
+  _log_safefree(sfc->bypath);
+  _log_safefree(sfc->byid);
+
+  sfc->size   = size;
+  sfc->bypath = bypath;
+  sfc->byid   = byid;
+  sfc->mask   = buckets - 1;
+
+  for (size_t n = 0; n < sfc->count; n++)
+    {
+      _log_fcache_index(sfc, n);
+    }
+
+  return true;
+}
+
+logfile *
+_log_fcache_findpath(logfcache *sfc, const logchar_t *path)
+{
+  bool found    = false;
+  size_t bucket = _log_fcache_bucket(sfc, true, path, &found);
+
+  return found ? sfc->files[sfc->bypath[bucket] - 1] : NULL;
+}
 
-          return &sf->id;
-        }
-    _log_safefree(sf);
-    }
+logfile *
+_log_fcache_findid(logfcache *sfc, logfileid_t id)
+{
+  bool found    = false;
+  size_t bucket = _log_fcache_bucket(sfc, false, id, &found);
 
-  return NULL;
+  return found ? sfc->files[sfc->byid[bucket] - 1] : NULL;
 }
 
 bool
-_log_fcache_update(logfcache *sfc, logfileid_t id, log_update_data *data)
+_log_fcache_destroy(logfcache *sfc)
 {
-  if (_log_validptr(sfc) && _log_validptr(id) && _log_validfid(*id)
-      && _log_validupdatedata(data))
+  if (_log_validptr(sfc))
     {
-      logfile *found
-        = _log_fcache_find(sfc, (const void *)id, _log_fcache_pred_id);
-      if (!found)
+      for (size_t n = 0; n < sfc->count; n++)
         {
-          _log_seterror(_LOG_E_NOFILE);
-          return false;
+          assert(_logfile_validate(sfc->files[n]));
+          _logfile_destroy(sfc->files[n]);
+          sfc->files[n] = NULL;
         }
 
-      _logfile_update(found, data);
+      _log_safefree(sfc->files);
+      _log_safefree(sfc->bypath);
+      _log_safefree(sfc->byid);
+      _log_safefree(sfc->routefiles);
+      _log_safefree(sfc->routegroups);
+
+      (void)memset(sfc, 0, sizeof ( logfcache ));
       return true;
     }
 
   return false;
 }
 
-bool
-_log_fcache_rem(logfcache *sfc, logfileid_t id)
+void
+_log_fcache_route(logfcache *sfc)
 {
-  if (_log_validptr(sfc) && _log_validptr(id) && _log_validfid(*id))
+  logfile **files       = sfc->routefiles;
+  logroutegroup *groups = sfc->routegroups;
+
+  for (size_t idx = 0; idx < LOG_NUMLEVELS; idx++)
     {
+      log_level level = (log_level)( 1 << idx );
+      logroute *route = &sfc->route[idx];
+
+      route->files   = files;
+      route->count   = 0;
+      route->groups  = groups;
+      route->ngroups = 0;
+
+      /* Find the distinct options among the files that want the level... */
       for (size_t n = 0; n < sfc->count; n++)
         {
-          assert(_logfile_validate(sfc->files[n]));
+          if (!_log_bittest(sfc->files[n]->levels, level))
+            {
+              continue;
+            }
+
+          size_t g = 0;
 
-          if (sfc->files[n]->id == *id)
+          while (g < route->ngroups && route->groups[g].opts != sfc->files[n]->opts)
             {
-              _logfile_destroy(sfc->files[n]);
+              g++;
+            }
 
-              for (size_t i = n; i < sfc->count - 1; i++)
-                {
-                  sfc->files[i]     = sfc->files[i + 1];
-                  sfc->files[i + 1] = NULL;
-                }
+          if (g == route->ngroups)
+            {
+              route->groups[g].opts  = sfc->files[n]->opts;
+              route->groups[g].count = 0;
+              route->ngroups++;
+            }
 
-              assert(sfc->count > 0);
-              sfc->count--;
+          route->groups[g].count++;
+        }
 
-              return true;
+      /* ...then list the files of each group together. */
+      for (size_t g = 0; g < route->ngroups; g++)
+        {
+          for (size_t n = 0; n < sfc->count; n++)
+            {
+              if (_log_bittest(sfc->files[n]->levels, level)
+                  && route->groups[g].opts == sfc->files[n]->opts)
+                {
+                  route->files[route->count++] = sfc->files[n];
+                }
             }
         }
 
-      _log_seterror(_LOG_E_NOFILE);
+      files  += route->count;
+      groups += route->ngroups;
     }
-
-  return false;
 }
 
-bool
-_log_fcache_pred_path(const void *match, logfile *iter)
+uint32_t
+_log_fcache_tick(void)
 {
-  const logchar_t *path = (const logchar_t *)match;
-
-#ifndef _WIN32
-  return 0 == strncmp(path, iter->path, LOG_MAXPATH);
-#else /* ifndef _WIN32 */
-  /* paths/file names are not case sensitive on windows. */
-  return 0 == _strnicmp(path, iter->path, LOG_MAXPATH);
-#endif /* ifndef _WIN32 */
-}
+  uint32_t wait  = LOG_WORKERWAIT;
+  logfcache *sfc = _log_locksection_shared(_LOGM_FILECACHE);
 
-bool
-_log_fcache_pred_id(const void *match, logfile *iter)
-{
-  logfileid_t id = (logfileid_t)match;
+  if (!sfc)
+    {
+      return wait;
+    }
 
-  return iter->id == *id;
-}
+  uint64_t now = _log_getmsec();
 
-logfile *
-_log_fcache_find(logfcache *sfc, const void *match, log_fcache_pred pred)
-{
-  if (_log_validptr(sfc) && _log_validptr(match) && _log_validptr(pred))
+  for (size_t n = 0; n < sfc->count; n++)
     {
-      for (size_t n = 0; n < sfc->count; n++)
+      logfile *sf = sfc->files[n];
+
+#ifdef LOG_URING
+      bool deferred = atomic_load(&sf->deferred);
+#else  /* ifdef LOG_URING */
+      bool deferred = false;
+#endif /* ifdef LOG_URING */
+
+      if (( 0 == sf->flush.msec && !deferred ) || !_logmutex_lock(&sf->mutex))
         {
-          if (pred(match, sfc->files[n]))
+          continue;
+        }
+
+      if (deferred)
+        {
+          /* Left buffered behind a write; it's waited for here instead. */
+          _logfile_flush(sf);
+        }
+      else if (sf->pending > 0)
+        {
+          uint64_t due = sf->since + sf->flush.msec;
+
+          if (due <= now)
+            {
+              _logfile_flushpolicy(sf);
+            }
+          else if (due - now < wait)
             {
-              return sfc->files[n];
+              wait = (uint32_t)( due - now );
             }
         }
+
+      (void)_logmutex_unlock(&sf->mutex);
     }
 
-  return NULL;
+#ifdef LOG_URING
+  _log_uring_flush();
+#endif /* ifdef LOG_URING */
+
+  (void)_log_unlocksection_shared(_LOGM_FILECACHE);
+  return wait;
 }
 
 bool
-_log_fcache_destroy(logfcache *sfc)
+_log_fcache_flush(logfcache *sfc)
 {
-  if (_log_validptr(sfc))
+  bool r = true;
+
+  for (size_t n = 0; n < sfc->count; n++)
     {
-      for (size_t n = 0; n < sfc->count; n++)
+      logfile *sf = sfc->files[n];
+
+      if (_logmutex_lock(&sf->mutex))
         {
-          assert(_logfile_validate(sfc->files[n]));
-          _logfile_destroy(sfc->files[n]);
-          sfc->files[n] = NULL;
-          assert(sfc->count > 0);
-          sfc->count--;
+          _logfile_flush(sf);
+          r &= _logmutex_unlock(&sf->mutex);
+        }
+      else
+        {
+          r = false;
         }
+    }
 
-      (void)memset(sfc, 0, sizeof ( logfcache ));
-      return true;
+#ifdef LOG_URING
+  _log_uring_drain();
+#endif /* ifdef LOG_URING */
+
+  return r;
+}
+
+#ifndef _WIN32
+void
+_log_fcache_atfork_prepare(logfcache *sfc)
+{
+  for (size_t n = 0; n < sfc->count; n++)
+    {
+      logfile *sf = sfc->files[n];
+
+      (void)_logmutex_lock(&sf->mutex);
+      _logfile_flush(sf);
     }
 
-  return false;
+# ifdef LOG_URING
+  /* Nothing is in flight in the child. */
+  _log_uring_drain();
+# endif /* ifdef LOG_URING */
+}
+
+void
+_log_fcache_atfork_unlock(logfcache *sfc)
+{
+  for (size_t n = 0; n < sfc->count; n++)
+    {
+      (void)_logmutex_unlock(&sfc->files[n]->mutex);
+    }
 }
+#endif /* ifndef _WIN32 */
 
 bool
 _log_fcache_dispatch(logfcache *sfc, log_level level, logoutput *output,
@@ -644,57 +2599,84 @@ _log_fcache_dispatch(logfcache *sfc, log_level level, logoutput *output,
   if (_log_validptr(sfc) && _log_validlevel(level) && _log_validptr(output)
       && _log_validptr(dispatched) && _log_validptr(wanted))
     {
-      bool r                 = true;
-      const logchar_t *write = NULL;
-      log_options lastopts   = 0;
+      const logroute *route = &sfc->route[_log_levelidx(level)];
+      logfile *const *sf    = route->files;
+
+      bool commit           = false;
 
       *dispatched = 0;
-      *wanted     = 0;
+      *wanted     = route->count;
 
-      for (size_t n = 0; n < sfc->count; n++)
+      for (size_t g = 0; g < route->ngroups; g++)
         {
-          assert(_logfile_validate(sfc->files[n]));
+          /* Formatted once for each group of files with the same options. */
+          logiovec vec;
+          bool formatted = _log_formatv(false, route->groups[g].opts, output, &vec);
+          assert(formatted);
 
-          if (!_log_bittest(sfc->files[n]->levels, level))
+          for (size_t n = 0; n < route->groups[g].count; n++, sf++)
             {
-              _log_selflog(
-                "%s: levels for %d (%04lx) not set for (%04lx); skipping...\n",
-                __func__,
-                sfc->files[n]->id,
-                sfc->files[n]->levels,
-                level);
-              continue;
-            }
+              assert(_logfile_validate(*sf));
 
-          ( *wanted )++;
+              bool write = false;
 
-          if (!write || sfc->files[n]->opts != lastopts)
-            {
-              write = _log_format(false, sfc->files[n]->opts, output);
-              assert(write);
-              lastopts = sfc->files[n]->opts;
-            }
+              if (formatted && _logmutex_lock(&( *sf )->mutex))
+                {
+                  if (_logfile_admit(*sf))
+                    {
+                      write = _logfile_write(*sf, &vec);
 
-          if (write && _logfile_write(sfc->files[n], write))
-            {
-              r &= true;
-              ( *dispatched )++;
-            }
-          else
-            {
-              _log_selflog(
-                "%s: write to %d failed!\n",
-                __func__,
-                sfc->files[n]->id);
+                      if (write)
+                        {
+                          _logfile_applyflush(*sf, level);
+                          commit |= _log_bittest(( *sf )->sync.levels, level);
+                        }
+                      else
+                        {
+                          _logfile_fault(*sf, 1);
+                        }
+                    }
+
+                  (void)_logmutex_unlock(&( *sf )->mutex);
+                }
+
+              if (write)
+                {
+                  ( *dispatched )++;
+                }
+              else
+                {
+                  _log_selflog(
+                    "%s: write to %d failed!\n",
+                    __func__,
+                    ( *sf )->id);
+                }
             }
         }
 
-      if (*dispatched > 0)
+#ifdef LOG_URING
+      /* One submission for every file's write. */
+      _log_uring_flush();
+#endif /* ifdef LOG_URING */
+
+      /* Written to every file before waiting on any of them to be synced. */
+      for (size_t n = 0; commit && n < route->count; n++)
         {
-          (void)_log_fflush_all();
+          logfile *cf = route->files[n];
+
+          if (_log_bittest(cf->sync.levels, level)
+              && _logmutex_lock(&cf->mutex))
+            {
+              if (!_logfile_commit(cf) && *dispatched > 0)
+                {
+                  ( *dispatched )--;
+                }
+
+              (void)_logmutex_unlock(&cf->mutex);
+            }
         }
 
-      return r && ( *dispatched == *wanted );
+      return *dispatched == *wanted;
     }
 
   return false;
@@ -724,6 +2706,120 @@ _log_fopen(const logchar_t *path)
   return NULL;
 }
 
+#ifndef _WIN32
+int
+_log_fdopen(const logchar_t *path, int flags)
+{
+  if (_log_validstr(path))
+    {
+      /* The same permissions fopen uses for new files. */
+      int fd = open(path, flags | O_CREAT | O_CLOEXEC,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+
+      if (LOG_INVALID == fd)
+        {
+          _log_handleerr(errno);
+        }
+
+      return fd;
+    }
+
+  return LOG_INVALID;
+}
+
+int
+_log_fdopendirect(const logchar_t *path)
+{
+# ifdef O_DIRECT
+  int fd = _log_fdopen(path, O_RDWR | O_DIRECT);
+
+  if (LOG_INVALID == fd)
+    {
+      /* Not supported by the file system (e.g. tmpfs); use the cache. */
+      _log_selflog("%s: O_DIRECT failed for '%s'; retrying without\n",
+                   __func__, path);
+      fd = _log_fdopen(path, O_RDWR);
+    }
+# else  /* ifdef O_DIRECT */
+  int fd = _log_fdopen(path, O_RDWR);
+
+#  ifdef F_NOCACHE
+  if (LOG_INVALID != fd && -1 == fcntl(fd, F_NOCACHE, 1))
+    {
+      _log_handleerr(errno);
+    }
+#  endif /* ifdef F_NOCACHE */
+# endif /* ifdef O_DIRECT */
+
+  return fd;
+}
+
+bool
+_log_fdmap(int fd, size_t len, logchar_t **map, size_t *maplen, uint64_t *size)
+{
+  struct stat st = { 0 };
+
+  if (0 != fstat(fd, &st))
+    {
+      _log_handleerr(errno);
+      return false;
+    }
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  len   = ( len + page - 1 ) / page * page;
+  *size = (uint64_t)st.st_size;
+
+  if ((uint64_t)st.st_size < len)
+    {
+      /* Allocate the blocks now; running out of space later raises SIGBUS. */
+      int alloc = posix_fallocate(fd, st.st_size, (off_t)len - st.st_size);
+
+      if (EINVAL == alloc || EOPNOTSUPP == alloc)
+        {
+          /* Not supported by the file system; settle for a sparse file. */
+          alloc = 0 == ftruncate(fd, (off_t)len) ? 0 : errno;
+        }
+
+      if (0 != alloc)
+        {
+          _log_handleerr(alloc);
+          return false;
+        }
+    }
+
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (MAP_FAILED == p)
+    {
+      _log_handleerr(errno);
+      (void)ftruncate(fd, (off_t)*size);
+      return false;
+    }
+
+  *map    = (logchar_t *)p;
+  *maplen = len;
+  return true;
+}
+
+void
+_log_fdunmap(int fd, logchar_t **map, size_t maplen, uint64_t size)
+{
+  if (0 != munmap(*map, maplen))
+    {
+      _log_handleerr(errno);
+    }
+
+  /* Drop the unused part of the preallocated space. */
+  if (0 != ftruncate(fd, (off_t)size))
+    {
+      _log_handleerr(errno);
+    }
+
+  *map = NULL;
+}
+#endif /* ifndef _WIN32 */
+
 void
 _log_fclose(FILE **f)
 {
@@ -750,6 +2846,71 @@ _log_fflush(FILE *f)
     }
 }
 
+bool
+_log_fdsync(int fd)
+{
+#ifdef _WIN32
+  if (0 != _commit(fd))
+#elif defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+  if (0 != fdatasync(fd))
+#else  /* ifdef _WIN32 */
+  if (0 != fsync(fd))
+#endif /* ifdef _WIN32 */
+    {
+      _log_handleerr(errno);
+      return false;
+    }
+
+  return true;
+}
+
+#ifndef _WIN32
+bool
+_log_writev(int fd, const logiovec *vec)
+{
+  logiov_t iov[LOG_MAXIOV];
+  logiov_t *next = iov;
+  int count      = vec->count;
+  size_t left    = vec->len;
+
+  (void)memcpy(iov, vec->iov, sizeof ( logiov_t ) * (size_t)count);
+
+  while (left > 0)
+    {
+      ssize_t wrote = writev(fd, next, count);
+
+      if (wrote < 0)
+        {
+          if (EINTR == errno)
+            {
+              continue;
+            }
+
+          _log_handleerr(errno);
+          return false;
+        }
+
+      left -= (size_t)wrote;
+
+      /* Partial write; skip what was written and try again. */
+      while (count > 0 && (size_t)wrote >= next->iov_len)
+        {
+          wrote -= (ssize_t)next->iov_len;
+          next++;
+          count--;
+        }
+
+      if (count > 0)
+        {
+          next->iov_base  = (char *)next->iov_base + wrote;
+          next->iov_len  -= (size_t)wrote;
+        }
+    }
+
+  return true;
+}
+#endif /* ifndef _WIN32 */
+
 bool
 _log_fflush_all(void)
 {
@@ -29,8 +29,6 @@
 
 # include "sirtypes.h"
 
-typedef bool (*log_fcache_pred) (const void *match, logfile *iter);
-
 typedef void (*log_fcache_update) (logfile *si, log_update_data *data);
 
 logfileid_t _log_addfile(const logchar_t *path, log_levels levels,
@@ -45,25 +43,266 @@ logfile *_logfile_create(const logchar_t *path, log_levels levels,
 
 bool _logfile_open(logfile *sf);
 
+/*
+ * Opens a file at path (e.g., the replacement for a rolled file) in place of
+ * the one currently open, which is closed.
+ */
+
+bool _logfile_openpath(logfile *sf, const logchar_t *path);
+
 void _logfile_close(logfile *sf);
 
-bool _log_write(logfile *sf, const logchar_t *output);
+bool _logfile_write(logfile *sf, const logiovec *vec);
 
 bool _logfile_writeheader(logfile *sf, const logchar_t *msg);
 
+/*
+ * Applies the flush policy of a file after a message of the given level was
+ * written to it. Called with the file locked.
+ */
+
+void _logfile_applyflush(logfile *sf, log_level level);
+
+/* Writes anything buffered for a file. Called with the file locked. */
+
+void _logfile_flush(logfile *sf);
+
+/*
+ * Writes what a flush policy calls for: for LOGB_DIRECT files, only the
+ * whole blocks buffered (the partial block is left for _logfile_flush);
+ * otherwise, as _logfile_flush. Called with the file locked.
+ */
+
+void _logfile_flushpolicy(logfile *sf);
+
+# ifndef _WIN32
+
+/*
+ * Copies a message into the buffer of a LOGB_FD file, first writing out
+ * what's there if it won't fit.
+ */
+
+bool _logfile_bufwrite(logfile *sf, const logiovec *vec);
+
+/* Copies a message to the end of a LOGB_MMAP file's mapping. */
+
+bool _logfile_mapwrite(logfile *sf, const logiovec *vec);
+
+/* Writes out the buffer of a LOGB_FD file, in a single write if possible. */
+
+bool _logfile_writebuf(logfile *sf);
+
+/*
+ * Copies a message into the buffer of a LOGB_DIRECT file, writing out the
+ * buffer's blocks whenever it fills.
+ */
+
+bool _logfile_directwrite(logfile *sf, const logiovec *vec);
+
+/*
+ * Writes out the whole blocks in the buffer of a LOGB_DIRECT file, and with
+ * tail, the partial block after them, padded to a whole block; the file is
+ * then truncated to its real size. The partial block stays in the buffer,
+ * to be written again once there's more of it.
+ */
+
+bool _logfile_writeblocks(logfile *sf, bool tail);
+
+/*
+ * Reads the partial block at the end of a LOGB_DIRECT file, just opened,
+ * into its buffer, so that it is written again with what follows.
+ */
+
+bool _logfile_readtail(logfile *sf);
+# endif /* ifndef _WIN32 */
+
+/*
+ * Determines whether a message may be written to a file. After a write
+ * fails, messages are dropped (and counted) without trying to write them
+ * until it's time to try again; then a line saying how many were dropped
+ * is written first. Called with the file locked.
+ */
+
+bool _logfile_admit(logfile *sf);
+
+/*
+ * Records a failed write to a file, and that dropped messages weren't
+ * written, and puts off trying again: for LOG_FRETRYMIN milliseconds,
+ * doubling with each failure in a row. Called with the file locked.
+ */
+
+void _logfile_fault(logfile *sf, uint64_t dropped);
+
+# ifdef LOG_URING
+/*
+ * Records, with _logfile_fault, a LOGB_URING write that failed since this
+ * was last called; its completion may have been handled by another thread,
+ * without the file locked. Called with the file locked.
+ */
+
+void _logfile_uringfault(logfile *sf);
+# endif /* ifdef LOG_URING */
+
+/*
+ * Syncs a file for every durable message written to it so far (see
+ * log_filesync), and wakes the threads waiting for that. With unlock, the
+ * file is unlocked while it's synced. Called with the file locked.
+ */
+
+bool _logfile_sync(logfile *sf, bool unlock);
+
+/*
+ * Waits until a sync covers the durable messages written to a file so far,
+ * syncing it if no other thread is. Returns false if that sync failed.
+ * Called with the file locked.
+ */
+
+bool _logfile_commit(logfile *sf);
+
+/*
+ * Switches a file to another backend and/or buffer size, reopening it if
+ * necessary. Called with the file cache section locked exclusively.
+ */
+
+bool _logfile_setwriter(logfile *sf, const logwriter *writer);
+
 bool _logfile_needsroll(logfile *sf);
 
-bool _logfile_roll(logfile *sf, logchar_t **newpath);
+/* Calculates when a file with a roll interval is next rolled. */
+
+void _logfile_setrollat(logfile *sf);
+
+/*
+ * Allocates a file's disk space up to its roll size, without changing its
+ * size, if it's to be preallocated (log_filepreallocate) and isn't already.
+ */
+
+void _logfile_preallocate(logfile *sf);
+
+/* Frees the space preallocated past the end of a file. */
+
+void _logfile_release(logfile *sf);
+
+/*
+ * Returns how much of a LOGB_MMAP file to map: size (what's been written),
+ * plus up to the roll size (at most LOG_FMAPSIZE more), extra, and room for
+ * one message.
+ */
+
+size_t _logfile_maplen(const logfile *sf, uint64_t size, size_t extra);
+
+/*
+ * Sets the size of a file from the file system (except for LOGB_MMAP files,
+ * whose length only libsir knows until they're closed).
+ */
+
+bool _logfile_syncsize(logfile *sf);
+
+/*
+ * Rolls a file: switches to a replacement, and has the background helper
+ * thread archive the file (see _log_archiveroll). If its queue is full, sets
+ * deferred and returns false; the file is rolled on a later write. Without
+ * threads (LOG_NO_ASYNC), archives the file, and compresses the archive if
+ * requested, before returning.
+ */
+
+bool _logfile_roll(logfile *sf, bool *deferred);
+
+/* Formats a name for an archive of the file at path rolled at when. */
+
+bool _log_archivepath(const logchar_t *path, time_t when, logchar_t **newpath);
 
 bool _logfile_archive(logfile *sf, const logchar_t *newpath);
 
-bool _logfile_splitpath(logfile *sf, logchar_t **name, logchar_t **ext);
+# ifndef LOG_NO_ASYNC
+
+/*
+ * Archives a rolled file: links path to a new archive name (stored in
+ * newpath), and renames its replacement to path. Called by the background
+ * helper thread.
+ */
+
+bool _log_archiveroll(const logrolljob *job, logchar_t **newpath);
+
+# endif /* ifndef LOG_NO_ASYNC */
+
+bool _log_splitpath(const logchar_t *path, logchar_t **name, logchar_t **ext);
+
+/* Determines whether a file has a retention policy (log_fileretain). */
+
+bool _logfile_retains(const logfile *sf);
+
+/*
+ * Has a file's archives found on disk (if they haven't been) and pruned
+ * according to its retention policy, by the background helper thread (or at
+ * once, without threads).
+ */
+
+void _logfile_queueprune(logfile *sf);
+
+/*
+ * Adds a new archive (if not NULL) to a file's archives, finding those
+ * already on disk first if they haven't been, and moves those that its
+ * retention policy no longer allows to expired.
+ */
+
+void _logfile_archived(logfile *sf, const logchar_t *archive,
+                       logarchives *expired);
+
+/* Moves the oldest of a file's archives to expired, per its policy. */
+
+void _logfile_expire(logfile *sf, time_t now, logarchives *expired);
+
+/* Appends an archive (taking ownership of path). */
+
+bool _logarchives_add(logarchives *a, logchar_t *path, uint64_t size,
+                      time_t mtime);
+
+/* Determines whether an archive at path is among a file's archives. */
+
+bool _logarchives_has(const logarchives *a, const logchar_t *path);
+
+void _logarchives_free(logarchives *a);
+
+/* Orders archives oldest first (for qsort). */
+
+int _logarchives_compare(const void *lhs, const void *rhs);
+
+/* Deletes archives, and frees them. */
+
+void _log_removearchives(logarchives *expired);
+
+/*
+ * Determines whether a directory entry is an archive (see LOG_FNAMEFORMAT)
+ * of a file whose name splits into base and ext, compressed or not.
+ */
+
+bool _log_isarchive(const logchar_t *name, const logchar_t *base,
+                    const logchar_t *ext);
+
+/* Finds the archives of the file at path on disk, oldest first. */
+
+bool _log_findarchives(const logchar_t *path, logarchives *found);
+
+# ifndef LOG_NO_ASYNC
+
+/*
+ * Adds a new archive (if not NULL) to the archives of the file at path, if
+ * it's still in the cache, and removes those its retention policy no longer
+ * allows. Called by the background helper thread with nothing locked; the
+ * file's mutex is held while its archives change, and the file cache section
+ * isn't held while searching directories or removing files.
+ */
+
+void _log_fcache_archived(const logchar_t *path, const logchar_t *archive);
+
+# endif /* ifndef LOG_NO_ASYNC */
 
 void _logfile_destroy(logfile *sf);
 
 bool _logfile_validate(logfile *sf);
 
-void _logfile_update(logfile *sf, log_update_data *data);
+bool _logfile_update(logfile *sf, log_update_data *data);
 
 logfileid_t _log_fcache_add(logfcache *sfc, const logchar_t *path,
                             log_levels levels, log_options opts);
@@ -75,22 +314,132 @@ bool _log_fcache_rem(logfcache *sfc, logfileid_t id);
 
 bool _log_fcache_pred_path(const void *match, logfile *iter);
 
-bool _log_fcache_pred_id(const void *match, logfile *iter);
+/*
+ * Hashes a key for one of the file cache indexes: a path (bypath), or a
+ * logfileid_t.
+ */
+
+size_t _log_fcache_hash(bool bypath, const void *key);
+
+/*
+ * Finds the bucket in one of the file cache indexes that holds a key, or
+ * the empty bucket where it would be added (found is false).
+ */
+
+size_t _log_fcache_bucket(const logfcache *sfc, bool bypath, const void *key,
+                          bool *found);
+
+/* Adds the file at files[n] to both file cache indexes. */
+
+void _log_fcache_index(logfcache *sfc, size_t n);
+
+/* Empties a bucket in one of the file cache indexes. */
+
+void _log_fcache_unindex(logfcache *sfc, bool bypath, size_t bucket);
+
+/*
+ * Makes room in the file cache for more files (up to LOG_MAXFILES), and
+ * rebuilds the indexes.
+ */
+
+bool _log_fcache_grow(logfcache *sfc);
+
+/* Looks up a file by path. */
+
+logfile *_log_fcache_findpath(logfcache *sfc, const logchar_t *path);
+
+/* Looks up a file by the identifier returned by _log_fcache_add. */
 
-logfile *_log_fcache_find(logfcache *sfc, const void *match,
-                          log_fcache_pred pred);
+logfile *_log_fcache_findid(logfcache *sfc, logfileid_t id);
 
 bool _log_fcache_destroy(logfcache *sfc);
 
+/*
+ * Rebuilds the routes (the files that want each level, grouped by their
+ * options) after files are added, removed or updated. Called with the
+ * file cache section locked exclusively.
+ */
+
+void _log_fcache_route(logfcache *sfc);
+
+/*
+ * Flushes files whose timed flush is due (called periodically by the
+ * background helper thread). Returns the time, in milliseconds, until the
+ * next one is due (at most LOG_WORKERWAIT).
+ */
+
+uint32_t _log_fcache_tick(void);
+
+/* Writes anything buffered for every file. */
+
+bool _log_fcache_flush(logfcache *sfc);
+
+# ifndef _WIN32
+
+/*
+ * Writes anything buffered for every file, and leaves each file's mutex
+ * locked, before fork (with the file cache locked exclusively).
+ */
+
+void _log_fcache_atfork_prepare(logfcache *sfc);
+
+/* Unlocks each file's mutex after fork, in the parent and the child. */
+
+void _log_fcache_atfork_unlock(logfcache *sfc);
+
+# endif /* ifndef _WIN32 */
+
 bool _log_fcache_dispatch(logfcache *sfc, log_level level, logoutput *output,
                           size_t *dispatched, size_t *wanted);
 
 FILE *_log_fopen(const logchar_t *path);
 
+# ifndef _WIN32
+
+/*
+ * Opens (creating if necessary) a file with open(2) and the given flags;
+ * the descriptor isn't inherited by exec'd programs. Returns LOG_INVALID
+ * on failure.
+ */
+
+int _log_fdopen(const logchar_t *path, int flags);
+
+/*
+ * Opens a file for reading and writing, bypassing the page cache if the
+ * file system allows it (O_DIRECT, or F_NOCACHE).
+ */
+
+int _log_fdopendirect(const logchar_t *path);
+
+/*
+ * Preallocates a file opened for reading and writing to at least len
+ * bytes, and maps that much of it into memory. size receives the length of
+ * the file before it was extended.
+ */
+
+bool _log_fdmap(int fd, size_t len, logchar_t **map, size_t *maplen,
+                uint64_t *size);
+
+/* Unmaps a file mapped by _log_fdmap, and truncates it to size. */
+
+void _log_fdunmap(int fd, logchar_t **map, size_t maplen, uint64_t size);
+# endif /* ifndef _WIN32 */
+
 void _log_fclose(FILE **f);
 
 void _log_fflush(FILE *f);
 
+/* Writes a file's data (and the metadata needed to read it) to storage. */
+
+bool _log_fdsync(int fd);
+
 bool _log_fflush_all(void);
 
+# ifndef _WIN32
+
+/* Writes every segment of vec to fd (in one call, unless interrupted). */
+
+bool _log_writev(int fd, const logiovec *vec);
+# endif /* ifndef _WIN32 */
+
 #endif /* !_LOG_FILECACHE_H_INCLUDED */
@@ -83,6 +83,20 @@ _log_validopts(log_options opts)
   return valid;
 }
 
+bool
+_log_validwriter(const logwriter *writer)
+{
+  bool valid = writer->type <= LOGB_DIRECT && writer->bufsize <= LOG_FBUFMAX;
+
+  if (!valid)
+    {
+      _log_seterror(_LOG_E_OPTIONS);
+      assert(valid);
+    }
+
+  return valid;
+}
+
 bool
 __log_validstr(const logchar_t *str, bool fail)
 {
@@ -141,6 +141,10 @@ _log_defaultopts(log_options *opts, log_options def)
 
 bool _log_validopts(log_options opts);
 
+/* Validates a log file backend and its buffer size. */
+
+bool _log_validwriter(const logwriter *writer);
+
 /* Validates a string pointer and optionally fails if it's invalid. */
 
 bool __log_validstr(const logchar_t *str, bool fail);
@@ -167,7 +171,9 @@ _log_validupdatedata(log_update_data *data)
 {
   return NULL != data
            && ((  NULL == data->levels || _log_validlevels(*data->levels))
-             && ( NULL == data->opts   || _log_validopts  (*data->opts)));
+             && ( NULL == data->opts   || _log_validopts  (*data->opts))
+             && ( NULL == data->flush  || _log_validlevels(data->flush->levels))
+             && ( NULL == data->writer || _log_validwriter(data->writer)));
 }
 
 /* Places a null terminator at the first index in a string buffer. */
@@ -178,4 +184,66 @@ _log_resetstr(logchar_t *str)
   str[0] = (logchar_t)'\0';
 }
 
+/* Maps a log_level to its index (0 = LOGL_EMERG ... 7 = LOGL_DEBUG). */
+
+static inline size_t
+_log_levelidx(log_level level)
+{
+  size_t idx = 0;
+
+  while (level > LOGL_EMERG)
+    {
+      level = (log_level)( level >> 1 );
+      idx++;
+    }
+
+  return idx;
+}
+
+/*
+ * Copies len characters from src to dest at offset off (without a null
+ * terminator), and returns the offset following them.
+ */
+
+static inline size_t
+_log_strappend(logchar_t *dest, size_t off, const logchar_t *src, size_t len)
+{
+  (void)memcpy(dest + off, src, len * sizeof ( logchar_t ));
+  return off + len;
+}
+
+/*
+ * Appends a segment of len characters to a list of output segments. Empty
+ * segments are omitted.
+ */
+
+static inline void
+_log_iovappend(logiovec *vec, const logchar_t *src, size_t len)
+{
+  if (0 != len)
+    {
+      assert(vec->count < LOG_MAXIOV);
+      vec->iov[vec->count].iov_base = (void *)src;
+      vec->iov[vec->count].iov_len  = len * sizeof ( logchar_t );
+      vec->count++;
+      vec->len += len;
+    }
+}
+
+/*
+ * Converts the return value of snprintf and friends to the length of the
+ * string that was actually stored in a buffer of the given size.
+ */
+
+static inline size_t
+_log_fmtlen(int fmt, size_t size)
+{
+  if (fmt < 0)
+    {
+      return 0;
+    }
+
+  return (size_t)fmt < size ? (size_t)fmt : size - 1;
+}
+
 #endif /* !_LOG_HELPERS_H_INCLUDED */
@@ -25,11 +25,14 @@
  */
 
 #include "sirinternal.h"
+#include "sirasync.h"
 #include "sirconsole.h"
 #include "sirdefaults.h"
 #include "sirfilecache.h"
 #include "sirmutex.h"
 #include "sirtextstyle.h"
+#include "siruring.h"
+#include "sirworker.h"
 
 static loginit _log_si = { 0 };
 static logfcache _log_fc = { 0 };
@@ -37,14 +40,52 @@ static logfcache _log_fc = { 0 };
 static logmutex_t si_mutex;
 static logonce_t  si_once = LOG_ONCE_INIT;
 
-static logmutex_t fc_mutex;
-static logonce_t  fc_once = LOG_ONCE_INIT;
+static logrwlock_t fc_lock;
+static logonce_t   fc_once = LOG_ONCE_INIT;
 
 static logmutex_t ts_mutex;
 static logonce_t  ts_once = LOG_ONCE_INIT;
 
 static volatile uint32_t _log_magic;
 
+/*
+ * Union of the levels wanted by the console and syslog destinations, and by
+ * the files in the cache; consulted before a message is formatted.
+ */
+
+static atomic_uint_fast16_t _log_si_levels;
+static atomic_uint_fast16_t _log_fc_levels;
+
+/*
+ * For each level, the options shared by every file that wants it; i.e., the
+ * fields that none of those files need rendered.
+ */
+
+static atomic_uint_fast32_t _log_fc_skip[LOG_NUMLEVELS];
+
+/* The levels that some file syncs before returning (log_filesync). */
+
+static atomic_uint_fast16_t _log_fc_sync;
+
+#ifndef _WIN32
+static logonce_t atfork_once = LOG_ONCE_INIT;
+
+/* Whether _log_atfork_prepare locked everything (libsir was initialized). */
+static bool _log_forklocked;
+#endif /* ifndef _WIN32 */
+
+/* Incremented in child processes; invalidates per-thread caches. */
+
+static atomic_uint_least32_t _log_forkgen;
+
+/* Per-thread process/thread identifiers. */
+
+static thread_local log_thread_id log_tid;
+
+/* Per-thread formatted time stamp. */
+
+static thread_local log_time_cache log_ts;
+
 bool
 _log_sanity(void)
 {
@@ -113,12 +154,28 @@ _log_init(loginit *si)
       return false;
     }
 
+#ifndef _WIN32
+  _log_once(&atfork_once, _log_atfork_once);
+  _log_console_init();
+#endif /* ifndef _WIN32 */
+
   loginit *_si = _log_locksection(_LOGM_INIT);
   assert(_si);
 
   if (_si)
     {
       (void)memcpy(_si, si, sizeof ( loginit ));
+      _log_updatesilevels(_si);
+
+#ifndef LOG_NO_ASYNC
+      if (_si->async && !_log_async_start())
+        {
+          (void)memset(_si, 0, sizeof ( loginit ));
+          _log_updatesilevels(_si);
+          (void)_log_unlocksection(_LOGM_INIT);
+          return false;
+        }
+#endif /* ifndef LOG_NO_ASYNC */
 
 #ifndef LOG_NO_SYSLOG
       if (0 != _si->d_syslog.levels)
@@ -167,6 +224,70 @@ _log_sysloglevels(loginit *si, log_update_data *data)
   si->d_syslog.levels = *data->levels;
 }
 
+void
+_log_updatesilevels(const loginit *si)
+{
+  log_levels levels = si->d_stdout.levels | si->d_stderr.levels;
+
+#ifndef LOG_NO_SYSLOG
+  levels |= si->d_syslog.levels;
+#endif /* ifndef LOG_NO_SYSLOG */
+
+  atomic_store_explicit(&_log_si_levels, levels, memory_order_relaxed);
+}
+
+void
+_log_updatefclevels(const logfcache *sfc)
+{
+  log_levels levels = 0;
+
+  for (size_t idx = 0; idx < LOG_NUMLEVELS; idx++)
+    {
+      const logroute *route = &sfc->route[idx];
+      log_options skip      = LOGO_MSGONLY;
+
+      for (size_t g = 0; g < route->ngroups; g++)
+        {
+          skip &= route->groups[g].opts;
+        }
+
+      if (route->count > 0)
+        {
+          levels |= (log_levels)( 1 << idx );
+        }
+
+      atomic_store_explicit(&_log_fc_skip[idx], skip, memory_order_relaxed);
+    }
+
+  atomic_store_explicit(&_log_fc_levels, levels, memory_order_relaxed);
+
+  log_levels sync = 0;
+
+  for (size_t n = 0; n < sfc->count; n++)
+    {
+      sync |= sfc->files[n]->levels & sfc->files[n]->sync.levels;
+    }
+
+  atomic_store_explicit(&_log_fc_sync, sync, memory_order_relaxed);
+}
+
+bool
+_log_wantlevel(log_level level)
+{
+  uint_fast16_t levels
+    = atomic_load_explicit(&_log_si_levels, memory_order_relaxed)
+      | atomic_load_explicit(&_log_fc_levels, memory_order_relaxed);
+
+  return _log_bittest(levels, level);
+}
+
+bool
+_log_wantsync(log_level level)
+{
+  return _log_bittest(atomic_load_explicit(&_log_fc_sync, memory_order_relaxed),
+                      level);
+}
+
 bool
 _log_writeinit(log_update_data *data, loginit_update update)
 {
@@ -179,6 +300,7 @@ _log_writeinit(log_update_data *data, loginit_update update)
       if (si)
         {
           update(si, data);
+          _log_updatesilevels(si);
           return _log_unlocksection(_LOGM_INIT);
         }
     }
@@ -189,12 +311,13 @@ _log_writeinit(log_update_data *data, loginit_update update)
 void *
 _log_locksection(log_mutex_id mid)
 {
-  logmutex_t *m = NULL;
-  void *sec     = NULL;
+  logmutex_t *m   = NULL;
+  logrwlock_t *rw = NULL;
+  void *sec       = NULL;
 
-  if (_log_mapmutexid(mid, &m, &sec))
+  if (_log_mapmutexid(mid, &m, &rw, &sec))
     {
-      bool enter = _logmutex_lock(m);
+      bool enter = m ? _logmutex_lock(m) : _logrwlock_wrlock(rw);
       assert(enter);
       return enter ? sec : NULL;
     }
@@ -205,12 +328,47 @@ _log_locksection(log_mutex_id mid)
 bool
 _log_unlocksection(log_mutex_id mid)
 {
-  logmutex_t *m = NULL;
-  void *sec     = NULL;
+  logmutex_t *m   = NULL;
+  logrwlock_t *rw = NULL;
+  void *sec       = NULL;
+
+  if (_log_mapmutexid(mid, &m, &rw, &sec))
+    {
+      bool leave = m ? _logmutex_unlock(m) : _logrwlock_wrunlock(rw);
+      assert(leave);
+      return leave;
+    }
+
+  return false;
+}
+
+void *
+_log_locksection_shared(log_mutex_id mid)
+{
+  logmutex_t *m   = NULL;
+  logrwlock_t *rw = NULL;
+  void *sec       = NULL;
+
+  if (_log_mapmutexid(mid, &m, &rw, &sec))
+    {
+      bool enter = m ? _logmutex_lock(m) : _logrwlock_rdlock(rw);
+      assert(enter);
+      return enter ? sec : NULL;
+    }
+
+  return NULL;
+}
+
+bool
+_log_unlocksection_shared(log_mutex_id mid)
+{
+  logmutex_t *m   = NULL;
+  logrwlock_t *rw = NULL;
+  void *sec       = NULL;
 
-  if (_log_mapmutexid(mid, &m, &sec))
+  if (_log_mapmutexid(mid, &m, &rw, &sec))
     {
-      bool leave = _logmutex_unlock(m);
+      bool leave = m ? _logmutex_unlock(m) : _logrwlock_rdunlock(rw);
       assert(leave);
       return leave;
     }
@@ -219,14 +377,16 @@ _log_unlocksection(log_mutex_id mid)
 }
 
 bool
-_log_mapmutexid(log_mutex_id mid, logmutex_t **m, void **section)
+_log_mapmutexid(log_mutex_id mid, logmutex_t **m, logrwlock_t **rw,
+                void **section)
 {
-  if (!_log_validptr(m))
+  if (!_log_validptr(m) || !_log_validptr(rw))
     {
       return false;
     }
 
-  logmutex_t *tmpm;
+  logmutex_t *tmpm   = NULL;
+  logrwlock_t *tmprw = NULL;
   void *tmpsec;
 
   switch (mid)
@@ -239,7 +399,7 @@ _log_mapmutexid(log_mutex_id mid, logmutex_t **m, void **section)
 
     case _LOGM_FILECACHE:
       _log_once(&fc_once, _log_initmutex_fc_once);
-      tmpm   = &fc_mutex;
+      tmprw  = &fc_lock;
       tmpsec = &_log_fc;
       break;
 
@@ -250,17 +410,17 @@ _log_mapmutexid(log_mutex_id mid, logmutex_t **m, void **section)
       break;
 
     default:
-      tmpm   = NULL;
       tmpsec = NULL;
     }
 
-  *m = tmpm;
+  *m  = tmpm;
+  *rw = tmprw;
   if (section)
     {
       *section = tmpsec;
     }
 
-  return *m != NULL && ( !section || *section != NULL );
+  return ( *m != NULL || *rw != NULL ) && ( !section || *section != NULL );
 }
 
 bool
@@ -272,6 +432,17 @@ _log_cleanup(void)
     }
 
   bool cleanup   = true;
+
+#ifndef LOG_NO_ASYNC
+  /* Write any queued messages before files are closed. */
+  cleanup &= _log_async_stop();
+  cleanup &= _log_worker_stop();
+#endif /* ifndef LOG_NO_ASYNC */
+
+#ifndef _WIN32
+  cleanup &= _log_console_flush();
+#endif /* ifndef _WIN32 */
+
   logfcache *sfc = _log_locksection(_LOGM_FILECACHE);
 
   assert(sfc);
@@ -280,9 +451,15 @@ _log_cleanup(void)
     {
       bool destroyfc = _log_fcache_destroy(sfc);
       assert(destroyfc);
+      _log_updatefclevels(sfc);
       cleanup &= _log_unlocksection(_LOGM_FILECACHE) && destroyfc;
     }
 
+#ifdef LOG_URING
+  /* The files that used it are closed. */
+  _log_uring_stop();
+#endif /* ifdef LOG_URING */
+
   loginit *si = _log_locksection(_LOGM_INIT);
 
   assert(si);
@@ -290,6 +467,7 @@ _log_cleanup(void)
   if (cleanup &= NULL != si) //-V1019
     {
       (void)memset(si, 0, sizeof ( loginit )); //-V575
+      _log_updatesilevels(si);
       cleanup &= _log_unlocksection(_LOGM_INIT);
     }
 
@@ -299,6 +477,50 @@ _log_cleanup(void)
   return cleanup;
 }
 
+bool
+_log_flush(void)
+{
+  _log_seterror(_LOG_E_NOERROR);
+
+  if (!_log_sanity())
+    {
+      return false;
+    }
+
+  bool flush = true;
+
+#ifndef LOG_NO_ASYNC
+  /* Queued messages come first. */
+  _log_async_drain();
+#endif /* ifndef LOG_NO_ASYNC */
+
+  logfcache *sfc = _log_locksection_shared(_LOGM_FILECACHE);
+
+  if (sfc)
+    {
+      flush &= _log_fcache_flush(sfc);
+      flush &= _log_unlocksection_shared(_LOGM_FILECACHE);
+    }
+  else
+    {
+      flush = false;
+    }
+
+#ifndef LOG_NO_ASYNC
+  /* Rolled files have their names back. */
+  _log_worker_waitrolls();
+#endif /* ifndef LOG_NO_ASYNC */
+
+#ifndef _WIN32
+  flush &= _log_console_flush();
+#endif /* ifndef _WIN32 */
+
+  _log_fflush(stdout);
+  _log_fflush(stderr);
+
+  return flush;
+}
+
 #ifndef _WIN32
 void
 _log_initmutex_si_once(void)
@@ -309,7 +531,10 @@ _log_initmutex_si_once(void)
 void
 _log_initmutex_fc_once(void)
 {
-  _log_initmutex(&fc_mutex);
+  bool init = _logrwlock_create(&fc_lock);
+
+  (void)init;
+  assert(init);
 }
 
 void
@@ -328,7 +553,10 @@ _log_initmutex_si_once(PINIT_ONCE ponce, PVOID param, PVOID *ctx)
 BOOL CALLBACK
 _log_initmutex_fc_once(PINIT_ONCE ponce, PVOID param, PVOID *ctx)
 {
-  _log_initmutex(&fc_mutex);
+  bool init = _logrwlock_create(&fc_lock);
+
+  (void)init;
+  assert(init);
   return TRUE;
 }
 
@@ -370,6 +598,13 @@ _log_logv(log_level level, const logchar_t *format, va_list args)
       return false;
     }
 
+  /* Nothing would be written; skip the locking and formatting entirely. */
+  if (!_log_wantlevel(level))
+    {
+      _log_seterror(_LOG_E_NODEST);
+      return false;
+    }
+
   loginit *si = _log_locksection(_LOGM_INIT);
 
   if (!si)
@@ -384,138 +619,174 @@ _log_logv(log_level level, const logchar_t *format, va_list args)
   (void)memcpy(&tmpsi, si, sizeof ( loginit ));
   (void)_log_unlocksection(_LOGM_INIT);
 
+#ifndef LOG_NO_ASYNC
+  if (tmpsi.async && _log_async_enter())
+    {
+      if (!_log_wantsync(level))
+        {
+          bool queued = _log_async_logv(&tmpsi, level, format, args);
+          _log_async_leave();
+          return queued;
+        }
+
+      /* Synced before returning; written here, after what's queued. */
+      _log_async_drain();
+      _log_async_leave();
+    }
+#endif /* ifndef LOG_NO_ASYNC */
+
   logbuf buf;
   logoutput output = {
     0
   };
 
-  output.style = _logbuf_get(&buf, _LOGBUF_STYLE);
-  assert(output.style);
+  _logbuf_mapoutput(&buf, &output);
+  _log_formatfields(&tmpsi, level, &output, format, args);
+
+  return _log_dispatch(&tmpsi, level, &output);
+}
 
-  bool appliedstyle = false;
-  log_textstyle style = _log_gettextstyle(level);
+log_options
+_log_skipfields(const loginit *si, log_level level, bool *styling)
+{
+  log_options skip = atomic_load_explicit(
+    &_log_fc_skip[_log_levelidx(level)], memory_order_relaxed);
 
-  assert(LOGS_INVALID != style);
+  *styling = false;
 
-  if (LOGS_INVALID != style)
+  if (_log_bittest(si->d_stdout.levels, level))
     {
-      bool fmtstyle = _log_formatstyle(style, output.style, LOG_MAXSTYLE);
-      assert(fmtstyle);
-      appliedstyle = fmtstyle;
+      skip     &= si->d_stdout.opts;
+      *styling |= _log_stdout_styled();
     }
 
-  if (!appliedstyle)
+  if (_log_bittest(si->d_stderr.levels, level))
     {
-      _log_resetstr(output.style);
+      skip     &= si->d_stderr.opts;
+      *styling |= _log_stderr_styled();
     }
 
-  output.timestamp = _logbuf_get(&buf, _LOGBUF_TIME);
-  assert(output.timestamp);
-
-  time_t now;
-  long long nowmsec;
-  bool gettime = _log_getlocaltime(&now, &nowmsec);
-
-  assert(gettime);
+  return skip;
+}
 
-  if (gettime)
+void
+_log_formatfields(const loginit *si, log_level level, logoutput *output,
+                  const logchar_t *format, va_list args)
+{
+  bool styling     = false;
+  log_options skip = _log_skipfields(si, level, &styling);
+
+  /* Fields that no destination wants are left empty. */
+  _log_resetstr(output->style);
+  _log_resetstr(output->timestamp);
+  _log_resetstr(output->msec);
+  _log_resetstr(output->level);
+  _log_resetstr(output->name);
+  _log_resetstr(output->pid);
+  _log_resetstr(output->tid);
+  (void)memset(output->len, 0, sizeof ( output->len ));
+  output->skip = skip;
+
+  if (styling)
     {
-      bool fmttime = _log_formattime(now, output.timestamp, LOG_TIMEFORMAT);
-      assert(fmttime);
-
-      if (!fmttime)
-        {
-          _log_resetstr(output.timestamp);
-        }
-
-      output.msec = _logbuf_get(&buf, _LOGBUF_MSEC);
-      assert(output.msec);
+      log_textstyle style = _log_gettextstyle(level);
 
-      int fmtmsec = snprintf(output.msec, LOG_MAXMSEC, LOG_MSECFORMAT, nowmsec);
-      assert(fmtmsec >= 0);
+      assert(LOGS_INVALID != style);
 
-      if (fmtmsec < 0)
+      if (LOGS_INVALID != style)
         {
-          _log_resetstr(output.msec);
+          bool fmtstyle = _log_formatstyle(style, output->style, LOG_MAXSTYLE);
+          assert(fmtstyle);
+
+          if (!fmtstyle)
+            {
+              _log_resetstr(output->style);
+            }
         }
+
+#ifndef _WIN32
+      output->len[_LOGBUF_STYLE] = strnlen(output->style, LOG_MAXSTYLE - 1);
+#else /* ifndef _WIN32 */
+      output->len[_LOGBUF_STYLE] = sizeof ( uint16_t );
+#endif /* ifndef _WIN32 */
     }
-  else
+
+  if (!_log_bittest(skip, LOGO_NOTIME))
     {
-      _log_resetstr(output.msec);
-    }
+      time_t now;
+      long long nowmsec;
+      bool wantmsec = !_log_bittest(skip, LOGO_NOMSEC);
+      bool gettime  = _log_getlocaltime(&now, wantmsec ? &nowmsec : NULL);
 
-  output.level = _logbuf_get(&buf, _LOGBUF_LEVEL);
-  assert(output.level);
-  (void)snprintf(
-    output.level,
-    LOG_MAXLEVEL,
-    LOG_LEVELFORMAT,
-    _log_levelstr(level));
+      assert(gettime);
 
-  output.name = _logbuf_get(&buf, _LOGBUF_NAME);
-  assert(output.name);
+      if (gettime)
+        {
+          bool fmttime = _log_formattimestamp(now, output->timestamp,
+                                              &output->len[_LOGBUF_TIME]);
+          assert(fmttime);
 
-  if (_log_validstrnofail(tmpsi.processName))
-    {
-      (void)strncpy(output.name, tmpsi.processName, LOG_MAXNAME);
-    }
-  else
-    {
-      _log_resetstr(output.name);
-    }
+          if (!fmttime)
+            {
+              _log_resetstr(output->timestamp);
+              output->len[_LOGBUF_TIME] = 0;
+            }
 
-  output.pid = _logbuf_get(&buf, _LOGBUF_PID);
-  assert(output.pid);
+          if (wantmsec)
+            {
+              _log_formatmsec(nowmsec, output->msec);
+              output->len[_LOGBUF_MSEC] = LOG_MAXMSEC - 1;
+            }
+        }
+    }
 
-  pid_t pid  = _log_getpid();
-  int pidfmt = snprintf(output.pid, LOG_MAXPID, LOG_PIDFORMAT, (unsigned long)pid);
+  if (!_log_bittest(skip, LOGO_NOLEVEL))
+    {
+      int lvlfmt = snprintf(
+        output->level,
+        LOG_MAXLEVEL,
+        LOG_LEVELFORMAT,
+        _log_levelstr(level));
 
-  assert(pidfmt >= 0);
+      output->len[_LOGBUF_LEVEL] = _log_fmtlen(lvlfmt, LOG_MAXLEVEL);
+    }
 
-  if (pidfmt < 0)
+  if (!_log_bittest(skip, LOGO_NONAME) && _log_validstrnofail(si->processName))
     {
-      _log_resetstr(output.pid);
+      size_t namelen = strnlen(si->processName, LOG_MAXNAME - 1);
+      (void)memcpy(output->name, si->processName, namelen);
+      output->name[namelen]     = (logchar_t)'\0';
+      output->len[_LOGBUF_NAME] = namelen;
     }
 
-  pid_t tid = _log_gettid();
-
-  output.tid = _logbuf_get(&buf, _LOGBUF_TID);
-  assert(output.tid);
-
-  if (tid != pid)
+  if (!_log_bittest(skip, LOGO_NOPID) || !_log_bittest(skip, LOGO_NOTID))
     {
-      if (!_log_getthreadname(output.tid))
+      const log_thread_id *id = _log_getthreadid();
+
+      if (!_log_bittest(skip, LOGO_NOPID))
         {
-          pidfmt = snprintf(output.tid, LOG_MAXPID, LOG_PIDFORMAT, (unsigned long)tid);
-          assert(pidfmt >= 0);
+          (void)memcpy(output->pid, id->pid_s, id->pid_len + 1);
+          output->len[_LOGBUF_PID] = id->pid_len;
+        }
 
-          if (pidfmt < 0)
-            {
-              _log_resetstr(output.tid);
-            }
+      if (!_log_bittest(skip, LOGO_NOTID))
+        {
+          (void)memcpy(output->tid, id->tid_s, id->tid_len + 1);
+          output->len[_LOGBUF_TID] = id->tid_len;
         }
     }
-  else
-    {
-      _log_resetstr(output.tid);
-    }
 
   /* TODO: Add support for glibc's %m? */
-  output.message = _logbuf_get(&buf, _LOGBUF_MSG);
-  assert(output.message);
-  int msgfmt = vsnprintf(output.message, LOG_MAXMESSAGE, format, args);
+  int msgfmt = vsnprintf(output->message, LOG_MAXMESSAGE, format, args);
 
   assert(msgfmt >= 0);
 
   if (msgfmt < 0)
     {
-      _log_resetstr(output.message);
+      _log_resetstr(output->message);
     }
 
-  output.output = _logbuf_get(&buf, _LOGBUF_OUTPUT);
-  assert(output.output);
-
-  return _log_dispatch(&tmpsi, level, &output);
+  output->len[_LOGBUF_MSG] = _log_fmtlen(msgfmt, LOG_MAXMESSAGE);
 }
 
 bool
@@ -526,20 +797,16 @@ _log_dispatch(loginit *si, log_level level, logoutput *output)
       bool r            = true;
       size_t dispatched = 0;
       size_t wanted     = 0;
+      bool sync         = _log_wantsync(level);
 
       if (_log_bittest(si->d_stdout.levels, level))
         {
-          const logchar_t *write /* = write */ = _log_format(true, si->d_stdout.opts, output);
-          (void)write;
-          assert(write);
-#ifndef _WIN32
-          bool wrote  = _log_stdout_write(write);
-          r          &= NULL != write && wrote;
-#else  /* ifndef _WIN32 */
-          uint16_t *style  = (uint16_t *)output->style;
-          bool wrote       = _log_stdout_write(*style, write);
-          r               &= NULL != write && NULL != style && wrote;
-#endif /* ifndef _WIN32 */
+          logiovec vec;
+          bool fmt    = _log_formatv(_log_stdout_styled(), si->d_stdout.opts,
+                                     output, &vec);
+          assert(fmt);
+          bool wrote  = fmt && _log_stdout_write(&vec, sync);
+          r          &= wrote;
           if (wrote)
             {
               dispatched++;
@@ -550,17 +817,13 @@ _log_dispatch(loginit *si, log_level level, logoutput *output)
 
       if (_log_bittest(si->d_stderr.levels, level))
         {
-          const logchar_t *write /* = write */ = _log_format(true, si->d_stderr.opts, output);
-          (void)write;
-          assert(write);
-#ifndef _WIN32
-          bool wrote  = _log_stderr_write(write);
-          r          &= NULL != write && wrote;
-#else  /* ifndef _WIN32 */
-          uint16_t *style  = (uint16_t *)output->style;
-          bool wrote       = _log_stderr_write(*style, write);
-          r               &= NULL != write && NULL != style && wrote;
-#endif /* ifndef _WIN32 */
+          logiovec vec;
+          bool fmt    = _log_formatv(_log_stderr_styled(), si->d_stderr.opts,
+                                     output, &vec);
+          assert(fmt);
+          bool drain  = sync || _log_bittest(log_stderr_drain_lvls, level);
+          bool wrote  = fmt && _log_stderr_write(&vec, drain);
+          r          &= wrote;
           if (wrote)
             {
               dispatched++;
@@ -578,14 +841,15 @@ _log_dispatch(loginit *si, log_level level, logoutput *output)
         }
 
 #endif /* ifndef LOG_NO_SYSLOG */
-      logfcache *sfc = _log_locksection(_LOGM_FILECACHE);
+      /* Files are locked individually while being written. */
+      logfcache *sfc = _log_locksection_shared(_LOGM_FILECACHE);
 
       if (sfc)
         {
           size_t fdispatched  = 0;
           size_t fwanted      = 0;
           r                  &= _log_fcache_dispatch(sfc, level, output, &fdispatched, &fwanted);
-          r                  &= _log_unlocksection(_LOGM_FILECACHE);
+          r                  &= _log_unlocksection_shared(_LOGM_FILECACHE);
           dispatched         += fdispatched;
           wanted             += fwanted;
         }
@@ -602,32 +866,45 @@ _log_dispatch(loginit *si, log_level level, logoutput *output)
   return false;
 }
 
-const logchar_t *
-_log_format(bool styling, log_options opts, logoutput *output)
+bool
+_log_formatv(bool styling, log_options opts, logoutput *output, logiovec *vec)
 {
-  if (_log_validopts(opts) && _log_validptr(output)
-      && _log_validptr(output->output))
+  if (_log_validopts(opts) && _log_validptr(output) && _log_validptr(vec))
     {
       bool first = true;
 
-      _log_resetstr(output->output);
+      /*
+       * Options may have changed since the fields were rendered (e.g., while
+       * the message was queued); fields that were skipped are left out.
+       */
+      opts |= output->skip & LOGO_MSGONLY;
+
+      vec->count = 0;
+      vec->len   = 0;
 
 #ifndef _WIN32
       if (styling)
         {
-          (void)strncat(output->output, output->style, LOG_MAXSTYLE);
+          _log_iovappend(vec, output->style, output->len[_LOGBUF_STYLE]);
+        }
+#else /* ifndef _WIN32 */
+      vec->style = 0;
+
+      if (styling && sizeof ( uint16_t ) == output->len[_LOGBUF_STYLE])
+        {
+          (void)memcpy(&vec->style, output->style, sizeof ( uint16_t ));
         }
 #endif /* ifndef _WIN32 */
 
       if (!_log_bittest(opts, LOGO_NOTIME))
         {
-          (void)strncat(output->output, output->timestamp, LOG_MAXTIME);
+          _log_iovappend(vec, output->timestamp, output->len[_LOGBUF_TIME]);
           first = false;
 
 #ifdef LOG_MSEC_TIMER
           if (!_log_bittest(opts, LOGO_NOMSEC))
             {
-              (void)strncat(output->output, output->msec, LOG_MAXMSEC);
+              _log_iovappend(vec, output->msec, output->len[_LOGBUF_MSEC]);
             }
 #endif /* ifdef LOG_MSEC_TIMER */
         }
@@ -636,81 +913,82 @@ _log_format(bool styling, log_options opts, logoutput *output)
         {
           if (!first)
             {
-              (void)strcat(output->output, " ");
+              _log_iovappend(vec, " ", 1);
             }
 
-          (void)strncat(output->output, output->level, LOG_MAXLEVEL);
+          _log_iovappend(vec, output->level, output->len[_LOGBUF_LEVEL]);
           first = false;
         }
 
       bool name = false;
-      if (!_log_bittest(opts, LOGO_NONAME)
-          && _log_validstrnofail(output->name))
+      if (!_log_bittest(opts, LOGO_NONAME) && 0 != output->len[_LOGBUF_NAME])
         {
           if (!first)
             {
-              (void)strcat(output->output, " ");
+              _log_iovappend(vec, " ", 1);
             }
 
-          (void)strncat(output->output, output->name, LOG_MAXNAME);
+          _log_iovappend(vec, output->name, output->len[_LOGBUF_NAME]);
           first = false;
           name  = true;
         }
 
-      bool wantpid = !_log_bittest(opts, LOGO_NOPID) && _log_validstrnofail(output->pid);
-      bool wanttid = !_log_bittest(opts, LOGO_NOTID) && _log_validstrnofail(output->tid);
+      bool wantpid = !_log_bittest(opts, LOGO_NOPID) && 0 != output->len[_LOGBUF_PID];
+      bool wanttid = !_log_bittest(opts, LOGO_NOTID) && 0 != output->len[_LOGBUF_TID];
 
       if (wantpid || wanttid)
         {
           if (name)
             {
-              (void)strcat(output->output, "(");
+              _log_iovappend(vec, "(", 1);
             }
           else if (!first)
             {
-              (void)strcat(output->output, " ");
+              _log_iovappend(vec, " ", 1);
             }
 
           if (wantpid)
             {
-              (void)strncat(output->output, output->pid, LOG_MAXPID);
+              _log_iovappend(vec, output->pid, output->len[_LOGBUF_PID]);
             }
 
           if (wanttid)
             {
               if (wantpid)
                 {
-                  (void)strcat(output->output, LOG_PIDSEPARATOR);
+                  _log_iovappend(vec, LOG_PIDSEPARATOR, sizeof ( LOG_PIDSEPARATOR ) - 1);
                 }
 
-              (void)strncat(output->output, output->tid, LOG_MAXPID);
+              _log_iovappend(vec, output->tid, output->len[_LOGBUF_TID]);
             }
 
           if (name)
             {
-              (void)strcat(output->output, ")");
+              _log_iovappend(vec, ")", 1);
             }
         }
 
       if (!first)
         {
-          (void)strcat(output->output, ": ");
+          _log_iovappend(vec, ": ", 2);
         }
 
-      (void)strncat(output->output, output->message, LOG_MAXMESSAGE);
+      _log_iovappend(vec, output->message, output->len[_LOGBUF_MSG]);
 
 #ifndef _WIN32
       if (styling)
         {
-          (void)strncat(output->output, LOG_ENDSTYLE, LOG_MAXSTYLE);
+          _log_iovappend(vec, LOG_ENDSTYLE, sizeof ( LOG_ENDSTYLE ) - 1);
         }
 #endif /* ifndef _WIN32 */
 
-      (void)strcat(output->output, "\n");
-      return output->output;
+      _log_iovappend(vec, "\n", 1);
+
+      assert(vec->len < LOG_MAXOUTPUT);
+      return true;
     }
 
-  return NULL;
+  return false;
 }
 
 #ifndef LOG_NO_SYSLOG
@@ -794,6 +1072,20 @@ _logbuf_get(logbuf *buf, size_t idx)
   return NULL;
 }
 
+void
+_logbuf_mapoutput(logbuf *buf, logoutput *output)
+{
+  output->style     = _logbuf_get(buf, _LOGBUF_STYLE);
+  output->timestamp = _logbuf_get(buf, _LOGBUF_TIME);
+  output->msec      = _logbuf_get(buf, _LOGBUF_MSEC);
+  output->level     = _logbuf_get(buf, _LOGBUF_LEVEL);
+  output->name      = _logbuf_get(buf, _LOGBUF_NAME);
+  output->pid       = _logbuf_get(buf, _LOGBUF_PID);
+  output->tid       = _logbuf_get(buf, _LOGBUF_TID);
+  output->message   = _logbuf_get(buf, _LOGBUF_MSG);
+  output->output    = _logbuf_get(buf, _LOGBUF_OUTPUT);
+}
+
 const logchar_t *
 _log_levelstr(log_level level)
 {
@@ -834,7 +1126,24 @@ _log_formattime(time_t now, logchar_t *buffer, const logchar_t *format)
 {
   if (0 != now && _log_validptr(buffer) && _log_validstr(format))
     {
-      size_t fmttime = strftime(buffer, LOG_MAXTIME, format, localtime(&now));
+      struct tm tm = {
+        0
+      };
+
+#ifndef _WIN32
+      bool local = NULL != localtime_r(&now, &tm);
+#else /* ifndef _WIN32 */
+      bool local = 0 == localtime_s(&tm, &now);
+#endif /* ifndef _WIN32 */
+      assert(local);
+
+      if (!local)
+        {
+          _log_handleerr(errno);
+          return false;
+        }
+
+      size_t fmttime = strftime(buffer, LOG_MAXTIME, format, &tm);
       assert(0 != fmttime);
 
       if (0 == fmttime)
@@ -852,11 +1161,49 @@ _log_formattime(time_t now, logchar_t *buffer, const logchar_t *format)
 }
 
 bool
-_log_getlocaltime(time_t *tbuf, long long *nsecbuf)
+_log_formattimestamp(time_t now, logchar_t buffer[LOG_MAXTIME], size_t *len)
+{
+  if (now != log_ts.when || !_log_validstrnofail(log_ts.timestamp))
+    {
+      if (!_log_formattime(now, log_ts.timestamp, LOG_TIMEFORMAT))
+        {
+          log_ts.when = 0;
+          return false;
+        }
+
+      log_ts.when = now;
+      log_ts.len  = strnlen(log_ts.timestamp, LOG_MAXTIME - 1);
+    }
+
+  (void)memcpy(buffer, log_ts.timestamp, log_ts.len + 1);
+
+  if (len)
+    {
+      *len = log_ts.len;
+    }
+
+  return true;
+}
+
+void
+_log_formatmsec(long long msec, logchar_t buffer[LOG_MAXMSEC])
+{
+  assert(msec >= 0 && msec < 1000);
+
+  unsigned m = (unsigned)( msec % 1000 );
+
+  buffer[0] = LOG_MSECSEPARATOR;
+  buffer[1] = (logchar_t)( '0' + ( m / 100 ));
+  buffer[2] = (logchar_t)( '0' + ( m / 10 % 10 ));
+  buffer[3] = (logchar_t)( '0' + ( m % 10 ));
+  buffer[4] = (logchar_t)'\0';
+}
+
+bool
+_log_getlocaltime(time_t *tbuf, long long *msecbuf)
 {
   if (tbuf)
     {
-      (void)time(tbuf);
 #ifdef LOG_MSEC_POSIX
       struct timespec ts = {
         0
@@ -866,15 +1213,23 @@ _log_getlocaltime(time_t *tbuf, long long *nsecbuf)
 
       if (0 == clock)
         {
-          if (nsecbuf)
+          *tbuf = ts.tv_sec;
+
+          if (msecbuf)
             {
-              *nsecbuf = ( ts.tv_nsec / 1e6 );
-              assert(*nsecbuf < 1000);
+              *msecbuf = ts.tv_nsec / 1000000L;
+              assert(*msecbuf < 1000);
             }
         }
       else
         {
-          *nsecbuf = 0;
+          (void)time(tbuf);
+
+          if (msecbuf)
+            {
+              *msecbuf = 0;
+            }
+
           _log_selflog("%s: clock_gettime failed; errno: %d\n", __func__, errno);
         }
 
@@ -893,20 +1248,20 @@ _log_getlocaltime(time_t *tbuf, long long *nsecbuf)
 
       *tbuf = (time_t)ftnow.QuadPart;
 
-      if (nsecbuf)
+      if (msecbuf)
         {
           SYSTEMTIME st = {
             0
           };
           FileTimeToSystemTime(&ftutc, &st);
-          *nsecbuf = st.wMilliseconds;
+          *msecbuf = st.wMilliseconds;
         }
 
 #else /* ifdef LOG_MSEC_POSIX */
       (void)time(tbuf);
-      if (nsecbuf)
+      if (msecbuf)
         {
-          *nsecbuf = 0;
+          *msecbuf = 0;
         }
 
 #endif /* ifdef LOG_MSEC_POSIX */
@@ -916,6 +1271,26 @@ _log_getlocaltime(time_t *tbuf, long long *nsecbuf)
   return false;
 }
 
+uint64_t
+_log_getmsec(void)
+{
+#ifndef _WIN32
+  struct timespec ts = {
+    0
+  };
+
+  if (0 != clock_gettime(CLOCK_MONOTONIC, &ts))
+    {
+      _log_handleerr(errno);
+      return 0;
+    }
+
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#else /* ifndef _WIN32 */
+  return (uint64_t)GetTickCount64();
+#endif /* ifndef _WIN32 */
+}
+
 pid_t
 _log_getpid(void)
 {
@@ -960,3 +1335,197 @@ _log_getthreadname(char name[LOG_MAXPID])
   return false;
 #endif /* if defined(_GNU_SOURCE) && !defined(_AIX) */
 }
+
+const log_thread_id *
+_log_getthreadid(void)
+{
+  uint32_t gen = atomic_load_explicit(&_log_forkgen, memory_order_relaxed);
+
+  if (log_tid.valid && log_tid.gen == gen)
+    {
+      return &log_tid;
+    }
+
+  log_tid.pid = _log_getpid();
+  log_tid.tid = _log_gettid();
+
+  int pidfmt = snprintf(log_tid.pid_s, LOG_MAXPID, LOG_PIDFORMAT,
+                        (unsigned long)log_tid.pid);
+  assert(pidfmt >= 0);
+
+  if (pidfmt < 0)
+    {
+      _log_resetstr(log_tid.pid_s);
+    }
+
+  /* A thread name set with log_setthreadname survives fork. */
+  if (!log_tid.named)
+    {
+      _log_resetstr(log_tid.tid_s);
+
+      if (log_tid.tid != log_tid.pid)
+        {
+          if (!_log_getthreadname(log_tid.tid_s)
+              || !_log_validstrnofail(log_tid.tid_s))
+            {
+              pidfmt = snprintf(log_tid.tid_s, LOG_MAXPID, LOG_PIDFORMAT,
+                                (unsigned long)log_tid.tid);
+              assert(pidfmt >= 0);
+
+              if (pidfmt < 0)
+                {
+                  _log_resetstr(log_tid.tid_s);
+                }
+            }
+        }
+    }
+
+  log_tid.pid_len = strnlen(log_tid.pid_s, LOG_MAXPID - 1);
+  log_tid.tid_len = strnlen(log_tid.tid_s, LOG_MAXPID - 1);
+  log_tid.gen     = gen;
+  log_tid.valid   = true;
+
+  return &log_tid;
+}
+
+bool
+_log_setthreadname(const logchar_t *name)
+{
+  _log_seterror(_LOG_E_NOERROR);
+
+  if (!_log_validstr(name))
+    {
+      return false;
+    }
+
+  logchar_t tmp[LOG_MAXPID] = {
+    0
+  };
+
+  (void)strncpy(tmp, name, LOG_MAXPID - 1);
+
+#if defined( __MACOS__ )
+  int set = pthread_setname_np(tmp);
+#elif defined( _GNU_SOURCE ) && !defined( _AIX )
+  int set = pthread_setname_np(pthread_self(), tmp);
+#else /* if defined( __MACOS__ ) */
+  int set = 0;
+#endif /* if defined( __MACOS__ ) */
+
+  if (0 != set)
+    {
+      _log_handleerr(set);
+      return false;
+    }
+
+  (void)_log_getthreadid();
+  (void)memcpy(log_tid.tid_s, tmp, LOG_MAXPID);
+  log_tid.tid_len = strnlen(log_tid.tid_s, LOG_MAXPID - 1);
+  log_tid.named   = true;
+
+  return true;
+}
+
+#ifndef _WIN32
+void
+_log_atfork_once(void)
+{
+  int op = pthread_atfork(_log_atfork_prepare, _log_atfork_parent,
+                          _log_atfork_child);
+
+  _log_handleerr(op);
+}
+
+void
+_log_atfork_prepare(void)
+{
+  _log_forklocked = _LOG_MAGIC == _log_magic;
+
+  if (!_log_forklocked)
+    {
+      return;
+    }
+
+  /*
+   * Every lock is taken, in the order they nest elsewhere, so that none is
+   * held by a thread which won't exist in the child.
+   */
+  (void)_log_locksection(_LOGM_INIT);
+  (void)_log_locksection(_LOGM_TEXTSTYLE);
+
+  logfcache *sfc = _log_locksection(_LOGM_FILECACHE);
+
+  if (sfc)
+    {
+      _log_fcache_atfork_prepare(sfc);
+    }
+
+# ifdef LOG_URING
+  _log_uring_atfork_prepare();
+# endif /* ifdef LOG_URING */
+
+  _log_console_atfork_prepare();
+
+# ifndef LOG_NO_ASYNC
+  _log_worker_atfork_prepare();
+  _log_async_atfork_prepare();
+# endif /* ifndef LOG_NO_ASYNC */
+
+  _log_fflush(stdout);
+  _log_fflush(stderr);
+}
+
+void
+_log_atfork_parent(void)
+{
+  if (!_log_forklocked)
+    {
+      return;
+    }
+
+# ifndef LOG_NO_ASYNC
+  _log_async_atfork_parent();
+  _log_worker_atfork_parent();
+# endif /* ifndef LOG_NO_ASYNC */
+
+  _log_console_atfork_parent();
+
+# ifdef LOG_URING
+  _log_uring_atfork_parent();
+# endif /* ifdef LOG_URING */
+
+  _log_fcache_atfork_unlock(&_log_fc);
+  (void)_log_unlocksection(_LOGM_FILECACHE);
+  (void)_log_unlocksection(_LOGM_TEXTSTYLE);
+  (void)_log_unlocksection(_LOGM_INIT);
+}
+
+void
+_log_atfork_child(void)
+{
+  (void)atomic_fetch_add(&_log_forkgen, 1);
+
+  if (!_log_forklocked)
+    {
+      return;
+    }
+
+# ifndef LOG_NO_ASYNC
+  _log_async_atfork_child();
+  _log_worker_atfork_child();
+# endif /* ifndef LOG_NO_ASYNC */
+
+  _log_console_atfork_child();
+
+# ifdef LOG_URING
+  _log_uring_atfork_child();
+# endif /* ifdef LOG_URING */
+
+  _log_fcache_atfork_unlock(&_log_fc);
+
+  /* The write lock belongs to the parent's thread; it's created anew. */
+  _log_initmutex_fc_once();
+  (void)_log_unlocksection(_LOGM_TEXTSTYLE);
+  (void)_log_unlocksection(_LOGM_INIT);
+}
+#endif /* ifndef _WIN32 */
@@ -70,17 +70,66 @@ typedef void (*loginit_update) (loginit *, log_update_data *);
 
 bool _log_writeinit(log_update_data *data, loginit_update update);
 
-/* Locks a protected section. */
+/*
+ * Recalculates the levels wanted by the console and syslog destinations.
+ * Called with the init section locked.
+ */
+
+void _log_updatesilevels(const loginit *si);
+
+/*
+ * Recalculates the levels wanted by the files in the cache, and for each
+ * level, the fields they need rendered, from its routes (see
+ * _log_fcache_route). Called with the file cache section locked.
+ */
+
+void _log_updatefclevels(const logfcache *sfc);
+
+/* Determines whether any destination currently wants messages of a level. */
+
+bool _log_wantlevel(log_level level);
+
+/*
+ * Determines whether some file syncs messages of a level before the call
+ * that logs them returns (log_filesync).
+ */
+
+bool _log_wantsync(log_level level);
+
+/* Locks a protected section (exclusively). */
 
 void *_log_locksection(log_mutex_id mid);
 
-/* Unlocks a protected section. */
+/* Unlocks a protected section locked by _log_locksection. */
 
 bool _log_unlocksection(log_mutex_id mid);
 
-/* Maps a log_mutex_id to a logmutex_t and protected section. */
+/*
+ * Locks a protected section for reading only. Sections guarded by a
+ * reader/writer lock may be held by many readers at once; others are
+ * locked exclusively.
+ */
+
+void *_log_locksection_shared(log_mutex_id mid);
+
+/* Unlocks a protected section locked by _log_locksection_shared. */
 
-bool _log_mapmutexid(log_mutex_id mid, logmutex_t **m, void **section);
+bool _log_unlocksection_shared(log_mutex_id mid);
+
+/*
+ * Maps a log_mutex_id to the logmutex_t or logrwlock_t (one of which is
+ * NULL) that guards it, and the protected section.
+ */
+
+bool _log_mapmutexid(log_mutex_id mid, logmutex_t **m, logrwlock_t **rw,
+                     void **section);
+
+/*
+ * Writes any queued messages, and anything buffered for log files, stdout
+ * and stderr.
+ */
+
+bool _log_flush(void);
 
 /* Frees allocated resources. */
 
@@ -92,7 +141,7 @@ bool _log_cleanup(void);
 
 void _log_initmutex_si_once(void);
 
-/* Initializes a specific mutex. */
+/* Initializes a specific reader/writer lock. */
 
 void _log_initmutex_fc_once(void);
 
@@ -107,7 +156,7 @@ void _log_initmutex_ts_once(void);
 BOOL CALLBACK _log_initmutex_si_once(PINIT_ONCE ponce, PVOID param,
                                      PVOID *ctx);
 
-/* Initializes a specific mutex. */
+/* Initializes a specific reader/writer lock. */
 
 BOOL CALLBACK _log_initmutex_fc_once(PINIT_ONCE ponce, PVOID param,
                                      PVOID *ctx);
@@ -130,14 +179,32 @@ void _log_once(logonce_t *once, log_once_fn func);
 
 bool _log_logv(log_level level, const logchar_t *format, va_list args);
 
+/*
+ * Determines which fields (LOGO_NO* flags) no destination that wants messages
+ * of a level needs, and whether the message is styled for the console.
+ */
+
+log_options _log_skipfields(const loginit *si, log_level level, bool *styling);
+
+/*
+ * Formats the component parts of output (time stamp, message, etc.) that
+ * are needed by at least one destination.
+ */
+
+void _log_formatfields(const loginit *si, log_level level, logoutput *output,
+                       const logchar_t *format, va_list args);
+
 /* Output dispatching. */
 
 bool _log_dispatch(loginit *si, log_level level, logoutput *output);
 
-/* Specific destination formatting. */
+/*
+ * Specific destination formatting, as a list of segments referring to the
+ * fields of output (no copies are made).
+ */
 
-const logchar_t *_log_format(bool styling, log_options opts,
-                             logoutput *output);
+bool _log_formatv(bool styling, log_options opts, logoutput *output,
+                  logiovec *vec);
 
 # ifndef LOG_NO_SYSLOG
 
@@ -151,18 +218,38 @@ int _log_syslog_maplevel(log_level level);
 
 logchar_t *_logbuf_get(logbuf *buf, size_t idx);
 
+/* Points each member of a logoutput at its buffer in a logbuf. */
+
+void _logbuf_mapoutput(logbuf *buf, logoutput *output);
+
 /* Converts a log_level to its human-readable form. */
 
 const logchar_t *_log_levelstr(log_level level);
 
 /* Retrieves the current local time w/ optional milliseconds. */
 
-bool _log_getlocaltime(time_t *tbuf, long long *nsecbuf);
+bool _log_getlocaltime(time_t *tbuf, long long *msecbuf);
+
+/* Returns a monotonic clock reading, in milliseconds. */
+
+uint64_t _log_getmsec(void);
 
 /* Formats the current time as a string. */
 
 bool _log_formattime(time_t now, logchar_t *buffer, const logchar_t *format);
 
+/*
+ * Formats a time as a string using LOG_TIMEFORMAT. The result is cached
+ * per thread, so the work is only done once per second.
+ */
+
+bool _log_formattimestamp(time_t now, logchar_t buffer[LOG_MAXTIME],
+                          size_t *len);
+
+/* Formats a millisecond value (0-999) for use in time stamps. */
+
+void _log_formatmsec(long long msec, logchar_t buffer[LOG_MAXMSEC]);
+
 /* Returns the current process identifier. */
 
 pid_t _log_getpid(void);
@@ -175,4 +262,42 @@ pid_t _log_gettid(void);
 
 bool _log_getthreadname(char name[LOG_MAXPID]);
 
+/*
+ * Returns the calling thread's cached process/thread identifiers,
+ * populating the cache first if necessary.
+ */
+
+const log_thread_id *_log_getthreadid(void);
+
+/* Sets the calling thread's name, and updates the cached identifiers. */
+
+bool _log_setthreadname(const logchar_t *name);
+
+# ifndef _WIN32
+
+/* Registers fork handlers. */
+
+void _log_atfork_once(void);
+
+/*
+ * Writes output buffered for log files, stdout and stderr before fork, so
+ * that it isn't written again by the child process, and takes every lock so
+ * that the child doesn't inherit one held by another thread.
+ */
+
+void _log_atfork_prepare(void);
+
+/* Releases the locks taken by _log_atfork_prepare in the parent process. */
+
+void _log_atfork_parent(void);
+
+/*
+ * Releases the locks taken by _log_atfork_prepare, and invalidates
+ * per-process state, in a child process after fork.
+ */
+
+void _log_atfork_child(void);
+
+# endif /* ifndef _WIN32 */
+
 #endif /* !_LOG_INTERNAL_H_INCLUDED */
@@ -110,6 +110,94 @@ _logmutex_destroy(logmutex_t *mutex)
   return false;
 }
 
+bool
+_logrwlock_create(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      pthread_rwlockattr_t attr;
+
+      int op = pthread_rwlockattr_init(&attr);
+      _log_handleerr(op);
+
+      if (0 == op)
+        {
+# if defined( __GLIBC__ )
+          /* Keep a steady stream of readers from starving writers. */
+          op = pthread_rwlockattr_setkind_np(
+            &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+          _log_handleerr(op);
+# endif /* if defined( __GLIBC__ ) */
+
+          op = pthread_rwlock_init(rwlock, &attr);
+          _log_handleerr(op);
+
+          (void)pthread_rwlockattr_destroy(&attr);
+          return 0 == op;
+        }
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_rdlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      int op = pthread_rwlock_rdlock(rwlock);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_wrlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      int op = pthread_rwlock_wrlock(rwlock);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_rdunlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      int op = pthread_rwlock_unlock(rwlock);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_wrunlock(logrwlock_t *rwlock)
+{
+  return _logrwlock_rdunlock(rwlock);
+}
+
+bool
+_logrwlock_destroy(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      int op = pthread_rwlock_destroy(rwlock);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
 #else /* Win32 mutex implementation */
 
 static bool _logmutex_waitwin32(logmutex_t mutex, DWORD msec);
@@ -182,6 +270,73 @@ _logmutex_destroy(logmutex_t *mutex)
   return false;
 }
 
+bool
+_logrwlock_create(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      InitializeSRWLock(rwlock);
+      return true;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_rdlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      AcquireSRWLockShared(rwlock);
+      return true;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_wrlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      AcquireSRWLockExclusive(rwlock);
+      return true;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_rdunlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      ReleaseSRWLockShared(rwlock);
+      return true;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_wrunlock(logrwlock_t *rwlock)
+{
+  if (_log_validptr(rwlock))
+    {
+      ReleaseSRWLockExclusive(rwlock);
+      return true;
+    }
+
+  return false;
+}
+
+bool
+_logrwlock_destroy(logrwlock_t *rwlock)
+{
+  /* Slim reader/writer locks need no cleanup. */
+  return _log_validptr(rwlock);
+}
+
 static bool
 _logmutex_waitwin32(logmutex_t mutex, DWORD msec)
 {
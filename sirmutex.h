@@ -49,4 +49,28 @@ bool _logmutex_unlock(logmutex_t *mutex);
 
 bool _logmutex_destroy(logmutex_t *mutex);
 
+/* Creates/initializes a new reader/writer lock (preferring writers). */
+
+bool _logrwlock_create(logrwlock_t *rwlock);
+
+/* Acquires a reader/writer lock for shared (read) access. */
+
+bool _logrwlock_rdlock(logrwlock_t *rwlock);
+
+/* Acquires a reader/writer lock for exclusive (write) access. */
+
+bool _logrwlock_wrlock(logrwlock_t *rwlock);
+
+/* Releases shared access to a reader/writer lock. */
+
+bool _logrwlock_rdunlock(logrwlock_t *rwlock);
+
+/* Releases exclusive access to a reader/writer lock. */
+
+bool _logrwlock_wrunlock(logrwlock_t *rwlock);
+
+/* Destroys a reader/writer lock. */
+
+bool _logrwlock_destroy(logrwlock_t *rwlock);
+
 #endif /* !_LOG_MUTEX_H_INCLUDED */
@@ -48,8 +48,10 @@
 # endif /* if defined( __APPLE__ ) && defined( __MACH__ ) */
 
 # include <assert.h>
+# include <ctype.h>
 # include <errno.h>
 # include <stdarg.h>
+# include <stdatomic.h>
 # include <stdbool.h>
 # include <stdint.h>
 # include <stdio.h>
@@ -60,16 +62,34 @@
 # include <time.h>
 
 # ifndef _WIN32
+#  include <dirent.h>
+#  include <fcntl.h>
 #  include <pthread.h>
+#  include <sched.h>
 #  include <strings.h>
+#  include <sys/mman.h>
 #  ifndef _AIX
 #   include <sys/syscall.h>
 #  endif
+#  include <sys/uio.h>
 #  include <syslog.h>
 #  include <unistd.h>
 
 #  ifdef __linux__
 #   include <linux/limits.h>
+
+/* io_uring (LOGB_URING), unless LOG_NO_URING is defined. */
+#   if !defined(LOG_NO_URING) && defined(__has_include)
+#    if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#     include <linux/io_uring.h>
+#     define LOG_URING
+#    endif
+#   endif
+
+/* Preallocation that leaves the file's size alone (log_filepreallocate). */
+#   ifdef FALLOC_FL_KEEP_SIZE
+#    define LOG_FALLOCATE
+#   endif
 #  endif /* ifdef __linux__ */
 
 #  ifdef PATH_MAX
@@ -87,6 +107,26 @@
 
 typedef pthread_mutex_t logmutex_t;
 
+/* The reader/writer lock type. */
+
+typedef pthread_rwlock_t logrwlock_t;
+
+/* The condition variable type. */
+
+typedef pthread_cond_t logcond_t;
+
+/* The thread type. */
+
+typedef pthread_t logthread_t;
+
+/* A segment of output (scatter/gather I/O). */
+
+typedef struct iovec logiov_t;
+
+/* The thread entry point type. */
+
+typedef void *(*log_thread_fn) (void *);
+
 /* The one-time type. */
 
 typedef pthread_once_t logonce_t;
@@ -110,6 +150,7 @@ typedef void (*log_once_fn) (void);
 
 #  define LOG_MAXPATH MAX_PATH
 #  define LOG_NO_SYSLOG
+#  define LOG_NO_ASYNC
 #  define LOG_MSEC_TIMER
 #  define LOG_MSEC_WIN32
 
@@ -117,6 +158,10 @@ typedef void (*log_once_fn) (void);
 
 typedef HANDLE logmutex_t;
 
+/* The reader/writer lock type. */
+
+typedef SRWLOCK logrwlock_t;
+
 /* The one-time type. */
 
 typedef INIT_ONCE logonce_t;
@@ -129,6 +174,14 @@ typedef int pid_t;
 
 typedef BOOL ( CALLBACK *log_once_fn ) (PINIT_ONCE, PVOID, PVOID *);
 
+/* A segment of output (mirrors struct iovec). */
+
+typedef struct
+{
+  void *iov_base;
+  size_t iov_len;
+} logiov_t;
+
 /* The one-time initializer. */
 
 #  define LOG_ONCE_INIT INIT_ONCE_STATIC_INIT
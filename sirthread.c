@@ -0,0 +1,161 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 9ec32238-c99f-11f1-81e1-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "sirthread.h"
+#include "sirinternal.h"
+#include "sirplatform.h"
+
+#ifndef LOG_NO_ASYNC
+
+bool
+_logcond_create(logcond_t *cond)
+{
+  if (_log_validptr(cond))
+    {
+      int op = pthread_cond_init(cond, NULL);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logcond_wait(logcond_t *cond, logmutex_t *mutex)
+{
+  if (_log_validptr(cond) && _log_validptr(mutex))
+    {
+      int op = pthread_cond_wait(cond, mutex);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logcond_timedwait(logcond_t *cond, logmutex_t *mutex, uint32_t msec)
+{
+  if (_log_validptr(cond) && _log_validptr(mutex))
+    {
+      struct timespec ts = {
+        0
+      };
+
+      if (0 != clock_gettime(CLOCK_REALTIME, &ts))
+        {
+          _log_handleerr(errno);
+          return false;
+        }
+
+      ts.tv_sec  += msec / 1000;
+      ts.tv_nsec += ( msec % 1000 ) * 1000000L;
+
+      if (ts.tv_nsec >= 1000000000L)
+        {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000L;
+        }
+
+      int op = pthread_cond_timedwait(cond, mutex, &ts);
+      if (ETIMEDOUT == op)
+        {
+          return true;
+        }
+
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logcond_signal(logcond_t *cond)
+{
+  if (_log_validptr(cond))
+    {
+      int op = pthread_cond_signal(cond);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logcond_broadcast(logcond_t *cond)
+{
+  if (_log_validptr(cond))
+    {
+      int op = pthread_cond_broadcast(cond);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logcond_destroy(logcond_t *cond)
+{
+  if (_log_validptr(cond))
+    {
+      int op = pthread_cond_destroy(cond);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logthread_create(logthread_t *thread, log_thread_fn fn, void *arg)
+{
+  if (_log_validptr(thread) && _log_validptr(fn))
+    {
+      int op = pthread_create(thread, NULL, fn, arg);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+bool
+_logthread_join(logthread_t *thread)
+{
+  if (_log_validptr(thread))
+    {
+      int op = pthread_join(*thread, NULL);
+      _log_handleerr(op);
+      return 0 == op;
+    }
+
+  return false;
+}
+
+#endif /* ifndef LOG_NO_ASYNC */
@@ -0,0 +1,71 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 9eb81a14-c99f-11f1-9eba-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _LOG_THREAD_H_INCLUDED
+# define _LOG_THREAD_H_INCLUDED
+
+# include "sirtypes.h"
+
+# ifndef LOG_NO_ASYNC
+
+/* Creates/initializes a new condition variable. */
+
+bool _logcond_create(logcond_t *cond);
+
+/* Waits indefinitely for a condition variable to be signaled. */
+
+bool _logcond_wait(logcond_t *cond, logmutex_t *mutex);
+
+/*
+ * Waits for a condition variable to be signaled, or for msec milliseconds
+ * to elapse (which is not considered an error).
+ */
+
+bool _logcond_timedwait(logcond_t *cond, logmutex_t *mutex, uint32_t msec);
+
+/* Wakes one thread waiting on a condition variable. */
+
+bool _logcond_signal(logcond_t *cond);
+
+/* Wakes all threads waiting on a condition variable. */
+
+bool _logcond_broadcast(logcond_t *cond);
+
+/* Destroys a condition variable. */
+
+bool _logcond_destroy(logcond_t *cond);
+
+/* Creates a new thread which begins executing fn(arg). */
+
+bool _logthread_create(logthread_t *thread, log_thread_fn fn, void *arg);
+
+/* Waits for a thread to exit. */
+
+bool _logthread_join(logthread_t *thread);
+
+# endif /* ifndef LOG_NO_ASYNC */
+
+#endif /* !_LOG_THREAD_H_INCLUDED */
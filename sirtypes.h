@@ -209,6 +209,15 @@ typedef struct
   log_stdio_dest d_stderr;  /* stderr configuration.                */
   log_syslog_dest d_syslog; /* syslog configuration (if available). */
 
+  /*
+   * If set, messages are formatted on the calling thread and queued; a
+   * background thread writes them to each destination. log_cleanup writes
+   * any messages remaining in the queue before returning. Has no effect if
+   * LOG_NO_ASYNC is defined.
+   */
+
+  bool async;
+
   /*
    * If set, defines the name that will appear in formatted output.
    * Set LOGO_NONAME for a destination to supppress it.
@@ -243,6 +252,102 @@ typedef struct
 
 /* Log file data. */
 
+/* How output is written to a log file (log_filebackend). */
+
+typedef enum
+{
+  LOGB_STDIO = 0, /* A C library stream (FILE *); the default.                */
+  LOGB_FD    = 1, /* A file descriptor, and a buffer owned by libsir (POSIX). */
+  LOGB_MMAP  = 2, /* A preallocated, memory-mapped file (POSIX).              */
+  LOGB_URING = 3, /* As LOGB_FD, but written through io_uring (Linux).        */
+  LOGB_DIRECT = 4, /* Aligned blocks, bypassing the page cache (POSIX).      */
+} log_backend;
+
+typedef struct
+{
+  log_backend type; /* The backend.                                         */
+  size_t bufsize;   /* The size of its buffer, in bytes (0 = LOG_FBUFSIZE). */
+} logwriter;
+
+/* When a log file is rolled (log_fileroll). */
+
+typedef struct
+{
+  uint64_t size;     /* Once it's this many bytes (0 = no limit).            */
+  uint32_t interval; /* At multiples of this many seconds (0 = no interval). */
+} logroll;
+
+/* When buffered output is written to a log file (log_fileflush). */
+
+typedef struct
+{
+  uint32_t count;    /* After this many messages (1 = unbuffered, 0 = never). */
+  uint32_t msec;     /* Once the oldest unwritten message is this old.        */
+  log_levels levels; /* Immediately after a message of one of these levels.  */
+} logflush;
+
+/*
+ * Group commit of a log file's output to storage (log_filesync). Messages
+ * are counted as they're written to the file; whichever thread finds no sync
+ * in progress syncs the file once for all of them.
+ */
+
+typedef struct
+{
+  log_levels levels; /* Messages of these levels wait until they're synced. */
+  uint64_t queued;   /* Those written to the file (or its kernel buffers).  */
+  uint64_t synced;   /* How many of them a sync has completed for.          */
+  uint64_t failfrom; /* The last failed sync was for those after failfrom,  */
+  uint64_t failto;   /* up to and including failto.                         */
+  bool syncing;      /* A thread is syncing the file, without its mutex.    */
+# ifndef LOG_NO_ASYNC
+  logcond_t cond;    /* Signaled when a sync completes.                     */
+# endif /* ifndef LOG_NO_ASYNC */
+} logsync;
+
+/*
+ * Failed writes to a log file. Once a write fails, messages are dropped
+ * until retryat; the next message then tries writing again.
+ */
+
+typedef struct
+{
+  uint32_t failures; /* Writes that failed in a row (0 = none).          */
+  uint64_t retryat;  /* When writing is next tried (msec).               */
+  uint64_t dropped;  /* Messages not written since the first failure.    */
+  int err;           /* The error the last failure was caused by.        */
+  bool rolled;       /* The file was rolled to recover from ENOSPC.      */
+} logfault;
+
+/* How long a log file's archives are kept (log_fileretain). */
+
+typedef struct
+{
+  uint32_t count; /* At most this many (0 = no limit).                */
+  uint64_t bytes; /* At most this many bytes in all (0 = no limit).   */
+  uint32_t age;   /* At most this many seconds old (0 = no limit).    */
+} logretain;
+
+/* An archive of a log file. */
+
+typedef struct
+{
+  logchar_t *path; /* Where it is.                  */
+  uint64_t size;   /* Its size, in bytes.           */
+  time_t mtime;    /* When it was last written to.  */
+} logarchive;
+
+/* The archives of a log file, oldest first. */
+
+typedef struct
+{
+  logarchive *items; /* The archives (items[0] to items[count - 1]).   */
+  size_t count;      /* The number of them.                            */
+  size_t size;       /* The number of elements allocated for items.    */
+  uint64_t bytes;    /* Their total size.                              */
+  bool indexed;      /* Those already on disk have been found.         */
+} logarchives;
+
 typedef struct
 {
   logchar_t *path;
@@ -250,30 +355,84 @@ typedef struct
   log_options opts;
   FILE *f;
   int id;
+  logmutex_t mutex; /* Serializes writes (and rolling) to this file. */
+  logflush flush;   /* Flush policy.                                 */
+  logroll roll;     /* Roll policy.                                  */
+  bool compress;    /* Compress archives (log_filecompress).         */
+  bool prealloc;    /* Preallocate to the roll size.                 */
+  uint64_t allocated; /* Where what was preallocated ends (0 = none). */
+  logsync sync;     /* Group commit of durable messages.            */
+  logfault fault;   /* Failed writes, and when to try again.         */
+  logretain retain; /* Retention policy for archives.                */
+  logarchives archives; /* Archives, once there's a retention policy. */
+  time_t rollat;    /* When it's next rolled (roll.interval).        */
+  logwriter writer; /* Backend.                                      */
+  logchar_t *buf;   /* Output buffered by libsir (LOGB_FD).          */
+  size_t buflen;    /* The number of bytes in buf.                   */
+  uint64_t bufoff;  /* Where buf goes in the file (LOGB_DIRECT).     */
+  size_t bufsynced; /* How much of buf is already in the file.       */
+# ifdef LOG_URING
+  logchar_t *inflight;  /* The other buffer, while it's written.     */
+  size_t inflightlen;   /* The number of bytes in it.                */
+  size_t inflightmsgs;  /* The number of messages in it.             */
+  atomic_int failed;    /* Why writing it failed (0 = it didn't).    */
+  atomic_size_t lost;   /* The messages that failure dropped.        */
+  atomic_bool busy;     /* inflight is being written (LOGB_URING).   */
+  atomic_bool deferred; /* buf waits for it, and the helper thread.  */
+# endif /* ifdef LOG_URING */
+  logchar_t *map;   /* The file, mapped into memory (LOGB_MMAP).     */
+  size_t maplen;    /* The length of map.                            */
+  size_t pending;   /* Messages buffered since the last flush.       */
+  uint64_t since;   /* When the oldest of those was buffered (msec). */
+  uint64_t size;    /* Size of the file, including buffered output.  */
+  uint32_t writes;  /* Writes since size was checked against the fs. */
 } logfile;
 
+/* Files in a logroute with the same log_options. */
+
+typedef struct
+{
+  log_options opts; /* The options they have in common. */
+  size_t count;     /* The number of them.              */
+} logroutegroup;
+
+/* The files that want messages of a level, grouped by their options. */
+
+typedef struct
+{
+  logfile **files;       /* The files; those in each group are adjacent. */
+  size_t count;          /* The number of files.                         */
+  logroutegroup *groups; /* The groups, in the order of files.           */
+  size_t ngroups;        /* The number of groups.                        */
+} logroute;
+
 /* Log file cache. */
 
 typedef struct
 {
-  logfile *files[LOG_MAXFILES];
-  size_t count;
+  logfile **files;  /* The files (files[0] to files[count - 1]).         */
+  size_t count;     /* The number of files.                             */
+  size_t size;      /* The number of elements allocated for files.      */
+  uint32_t *bypath; /* Index by path: 1 + index into files (0 = empty). */
+  uint32_t *byid;   /* Index by logfileid_t: as for bypath.             */
+  size_t mask;      /* The number of buckets in each index, minus 1.    */
+  logroute route[LOG_NUMLEVELS]; /* Indexed by _log_levelidx.            */
+  logfile **routefiles;          /* Storage for each route's files.      */
+  logroutegroup *routegroups;    /* Storage for each route's groups.     */
 } logfcache;
 
-/* Formatted output sent to destinations. */
+/* Output to stdout or stderr. */
 
 typedef struct
 {
-  logchar_t *style;
-  logchar_t *timestamp;
-  logchar_t *msec;
-  logchar_t *level;
-  logchar_t *name;
-  logchar_t *pid;
-  logchar_t *tid;
-  logchar_t *message;
-  logchar_t *output;
-} logoutput;
+  int fd;           /* STDOUT_FILENO or STDERR_FILENO.                  */
+  FILE *stream;     /* stdout or stderr; flushed before fd is written.  */
+  bool tty;         /* A terminal: written to directly, with styles.    */
+  logmutex_t mutex; /* Serializes access to buf.                        */
+  logchar_t *buf;   /* Output, when it's not a terminal.                */
+  size_t len;       /* The number of bytes in buf.                      */
+  uint64_t since;   /* When the oldest of those was buffered (msec).    */
+} logconsole;
 
 /* Indexes into logbuf buffers. */
 
@@ -291,6 +450,38 @@ typedef enum
   _LOGBUF_MAX
 } logbuf_idx;
 
+/* Formatted output sent to destinations. */
+
+typedef struct
+{
+  logchar_t *style;
+  logchar_t *timestamp;
+  logchar_t *msec;
+  logchar_t *level;
+  logchar_t *name;
+  logchar_t *pid;
+  logchar_t *tid;
+  logchar_t *message;
+  logchar_t *output;
+  size_t len[_LOGBUF_MAX]; /* Length of each member, by logbuf_idx. */
+  log_options skip;        /* Fields that were left empty.          */
+} logoutput;
+
+/*
+ * Formatted output for one destination, as a list of segments referring to
+ * the members of a logoutput (and constant separators).
+ */
+
+typedef struct
+{
+  logiov_t iov[LOG_MAXIOV];
+  int count;  /* Number of segments in use. */
+  size_t len; /* Total length of all segments. */
+# ifdef _WIN32
+  uint16_t style; /* Console attributes, rather than a segment (0 = none). */
+# endif /* ifdef _WIN32 */
+} logiovec;
+
 /* Buffers for output formatting. */
 
 typedef struct
@@ -306,6 +497,111 @@ typedef struct
   logchar_t output    [LOG_MAXOUTPUT];
 } logbuf;
 
+# ifndef LOG_NO_ASYNC
+
+/* A message queued for the background writer thread. */
+
+typedef struct
+{
+  atomic_size_t seq;       /* Position in the queue when this slot is usable. */
+  log_level level;         /* The level of the message.                      */
+  logbuf buf;              /* Formatted message data.                        */
+  size_t len[_LOGBUF_MAX]; /* Length of each member of buf.                  */
+  log_options skip;        /* Fields of buf that were left empty.            */
+  loginit si;              /* The configuration it was queued with.          */
+} logrecord;
+
+/*
+ * Bounded multiple producer, single consumer queue of formatted messages
+ * (asynchronous mode).
+ */
+
+typedef struct
+{
+  logrecord *records;       /* LOG_ASYNCQUEUE slots.                   */
+  size_t mask;              /* LOG_ASYNCQUEUE - 1.                     */
+  atomic_size_t head;       /* Next position to be claimed (producer). */
+  atomic_size_t tail;       /* Next position to be written (consumer). */
+  atomic_bool sleeping;     /* The writer is waiting for messages.     */
+  atomic_bool stop;         /* The writer should drain and exit.       */
+  atomic_bool running;      /* The writer was started by this process. */
+  atomic_size_t producers;  /* Threads between enter and leave.        */
+  logmutex_t mutex;         /* Protects waits on cond.                 */
+  logcond_t cond;           /* Signaled when messages are queued.      */
+  logthread_t thread;       /* The writer thread.                      */
+} logqueue;
+
+/*
+ * A rolled log file, to be archived by the background helper thread: path is
+ * renamed to an archive, then tmppath (the file that replaced it) to path.
+ * Without tmppath, nothing was rolled; the file's archives are just pruned
+ * according to its retention policy.
+ */
+
+typedef struct
+{
+  logchar_t *path;    /* The log file's path.                   */
+  logchar_t *tmppath; /* Where its replacement was opened.      */
+  time_t when;        /* When it was rolled (names the archive). */
+  bool compress;      /* Compress the archive afterwards.       */
+} logrolljob;
+
+/*
+ * Background helper thread, which performs housekeeping (e.g., flushing
+ * files on a timer) on behalf of the threads that log.
+ */
+
+typedef struct
+{
+  logmutex_t mutex;
+  logcond_t cond;
+  logcond_t renamed;    /* Signaled as queued rolls are renamed. */
+  logthread_t thread;
+  atomic_int state;     /* Stopped, starting or running.   */
+  atomic_bool sleeping; /* Waiting with nothing scheduled. */
+  atomic_bool stop;     /* Exit requested.                 */
+  bool woken;           /* Signaled since the last wait.   */
+  logrolljob rolls[LOG_ROLLQUEUE]; /* Rolled files to archive.             */
+  size_t nrolls;                   /* The number of them queued.           */
+  size_t reserved;                 /* Room reserved in rolls for others.   */
+  size_t renaming;                 /* Dequeued, but not yet renamed.       */
+} logworker;
+
+# endif /* ifndef LOG_NO_ASYNC */
+
+# ifdef LOG_URING
+
+/*
+ * The io_uring shared by LOGB_URING log files, and its queues (mapped from
+ * the kernel; see io_uring_setup(2)).
+ */
+
+typedef struct
+{
+  int fd;                    /* The ring.                                   */
+  unsigned *sqhead;          /* Submission queue: consumed up to here,      */
+  unsigned *sqtail;          /*   and filled up to here.                    */
+  unsigned *sqmask;
+  unsigned *sqarray;         /* Indexes into sqes, in order.                */
+  unsigned sqentries;
+  struct io_uring_sqe *sqes; /* The submission queue entries.               */
+  unsigned *cqhead;          /* Completion queue: reaped up to here,        */
+  unsigned *cqtail;          /*   and filled up to here.                    */
+  unsigned *cqmask;
+  struct io_uring_cqe *cqes; /* The completion queue entries.               */
+  void *sqmap;               /* The mappings, and their lengths.            */
+  size_t sqmaplen;
+  void *cqmap;
+  size_t cqmaplen;
+  size_t sqeslen;
+  unsigned inflight;         /* Writes queued or submitted, not completed.  */
+  atomic_uint queued;        /* Writes queued, not yet submitted.           */
+  atomic_int state;          /* Stopped, starting, running or unavailable.  */
+  logmutex_t mutex;          /* Protects the queues.                        */
+} logring;
+
+# endif /* ifdef LOG_URING */
+
 /* log_level <> log_textstyle mapping. */
 
 typedef struct
@@ -347,6 +643,30 @@ typedef struct
   } loc;
 } log_thread_err;
 
+/* Per-thread cache of the formatted time stamp for the current second. */
+
+typedef struct
+{
+  time_t when;                       /* The second that was formatted. */
+  logchar_t timestamp[LOG_MAXTIME];  /* The formatted time stamp.      */
+  size_t len;                        /* The length of timestamp.       */
+} log_time_cache;
+
+/* Per-thread cache of formatted process/thread identifiers. */
+
+typedef struct
+{
+  uint32_t gen;                 /* Fork generation when populated.            */
+  pid_t pid;                    /* The process identifier.                    */
+  pid_t tid;                    /* The thread identifier.                     */
+  logchar_t pid_s[LOG_MAXPID];  /* The formatted process identifier.          */
+  logchar_t tid_s[LOG_MAXPID];  /* The thread name or formatted identifier.   */
+  size_t pid_len;               /* The length of pid_s.                       */
+  size_t tid_len;               /* The length of tid_s.                       */
+  bool named;                   /* tid_s was set by log_setthreadname.        */
+  bool valid;                   /* The members have been populated.           */
+} log_thread_id;
+
 /*
  * Used to encapsulate dynamic updating of
  * config; add members here if necessary.
@@ -356,6 +676,13 @@ typedef struct
 {
   log_levels *levels;
   log_options *opts;
+  logflush *flush;
+  logwriter *writer;
+  logroll *roll;
+  bool *compress;
+  logretain *retain;
+  log_levels *sync;
+  bool *prealloc;
 } log_update_data;
 
 #endif /* !_LOG_TYPES_H_INCLUDED */
@@ -0,0 +1,435 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 24183dc4-c9a5-11f1-b3cf-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "siruring.h"
+#include "sirfilecache.h"
+#include "sirinternal.h"
+#include "sirmutex.h"
+
+#ifdef LOG_URING
+
+enum
+{
+  _LOG_URING_STOPPED = 0,
+  _LOG_URING_STARTING,
+  _LOG_URING_RUNNING,
+  _LOG_URING_UNAVAILABLE
+};
+
+static logring _log_ring;
+
+/* Whether _log_uring_atfork_prepare locked the ring's mutex. */
+static bool _log_ring_forklocked;
+
+bool
+_log_uring_start(void)
+{
+  logring *r = &_log_ring;
+  int state  = _LOG_URING_STOPPED;
+
+  if (!atomic_compare_exchange_strong(&r->state, &state, _LOG_URING_STARTING))
+    {
+      /* Another thread got here first; wait for it to finish. */
+      while (_LOG_URING_STARTING == state)
+        {
+          (void)sched_yield();
+          state = atomic_load(&r->state);
+        }
+
+      return _LOG_URING_RUNNING == state;
+    }
+
+  r->inflight = 0;
+  atomic_init(&r->queued, 0);
+
+  if (_logmutex_create(&r->mutex))
+    {
+      if (_log_uring_setup(r))
+        {
+          atomic_store(&r->state, _LOG_URING_RUNNING);
+          _log_selflog("%s: io_uring %d set up\n", __func__, r->fd);
+          return true;
+        }
+
+      (void)_logmutex_destroy(&r->mutex);
+    }
+
+  /* Not tried again; LOGB_URING files are written as LOGB_FD files. */
+  atomic_store(&r->state, _LOG_URING_UNAVAILABLE);
+  _log_selflog("%s: io_uring is not available\n", __func__);
+  return false;
+}
+
+void
+_log_uring_stop(void)
+{
+  logring *r = &_log_ring;
+
+  if (_LOG_URING_RUNNING == atomic_load(&r->state))
+    {
+      _log_uring_drain();
+      _log_uring_teardown(r);
+      (void)_logmutex_destroy(&r->mutex);
+      atomic_store(&r->state, _LOG_URING_STOPPED);
+    }
+}
+
+bool
+_log_uring_setup(logring *r)
+{
+  struct io_uring_params p;
+
+  (void)memset(&p, 0, sizeof ( p ));
+
+  r->fd = (int)syscall(__NR_io_uring_setup, LOG_URINGENTRIES, &p);
+
+  if (r->fd < 0)
+    {
+      _log_handleerr(errno);
+      return false;
+    }
+
+  /* Writes at the current position (the end, with O_APPEND) need 5.6. */
+  if (!( p.features & IORING_FEAT_RW_CUR_POS ))
+    {
+      (void)close(r->fd);
+      _log_handleerr(ENOTSUP);
+      return false;
+    }
+
+  r->sqmaplen = p.sq_off.array + p.sq_entries * sizeof ( unsigned );
+  r->cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof ( struct io_uring_cqe );
+  r->sqeslen  = p.sq_entries * sizeof ( struct io_uring_sqe );
+
+  r->sqmap = mmap(NULL, r->sqmaplen, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cqmap = mmap(NULL, r->cqmaplen, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes  = (struct io_uring_sqe *)mmap(NULL, r->sqeslen,
+                                         PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, r->fd,
+                                         IORING_OFF_SQES);
+
+  if (MAP_FAILED == r->sqmap || MAP_FAILED == r->cqmap
+      || MAP_FAILED == (void *)r->sqes)
+    {
+      _log_handleerr(errno);
+      _log_uring_teardown(r);
+      return false;
+    }
+
+  uint8_t *sq = (uint8_t *)r->sqmap;
+  uint8_t *cq = (uint8_t *)r->cqmap;
+
+  r->sqhead    = (unsigned *)( sq + p.sq_off.head );
+  r->sqtail    = (unsigned *)( sq + p.sq_off.tail );
+  r->sqmask    = (unsigned *)( sq + p.sq_off.ring_mask );
+  r->sqarray   = (unsigned *)( sq + p.sq_off.array );
+  r->sqentries = p.sq_entries;
+  r->cqhead    = (unsigned *)( cq + p.cq_off.head );
+  r->cqtail    = (unsigned *)( cq + p.cq_off.tail );
+  r->cqmask    = (unsigned *)( cq + p.cq_off.ring_mask );
+  r->cqes      = (struct io_uring_cqe *)( cq + p.cq_off.cqes );
+  return true;
+}
+
+void
+_log_uring_teardown(logring *r)
+{
+  if (_log_validptr(r->sqmap) && MAP_FAILED != r->sqmap)
+    {
+      (void)munmap(r->sqmap, r->sqmaplen);
+    }
+
+  if (_log_validptr(r->cqmap) && MAP_FAILED != r->cqmap)
+    {
+      (void)munmap(r->cqmap, r->cqmaplen);
+    }
+
+  if (_log_validptr(r->sqes) && MAP_FAILED != (void *)r->sqes)
+    {
+      (void)munmap(r->sqes, r->sqeslen);
+    }
+
+  (void)close(r->fd);
+
+  r->sqmap = r->cqmap = NULL;
+  r->sqes  = NULL;
+  r->fd    = LOG_INVALID;
+}
+
+bool
+_log_uring_write(logfile *sf)
+{
+  logring *r = &_log_ring;
+
+  if (!_logmutex_lock(&r->mutex))
+    {
+      return false;
+    }
+
+  unsigned tail = *r->sqtail;
+
+  if (tail - __atomic_load_n(r->sqhead, __ATOMIC_ACQUIRE) >= r->sqentries)
+    {
+      /* Full; make room. */
+      _log_uring_submit(r, 0);
+      tail = *r->sqtail;
+    }
+
+  unsigned idx             = tail & *r->sqmask;
+  struct io_uring_sqe *sqe = &r->sqes[idx];
+
+  (void)memset(sqe, 0, sizeof ( *sqe ));
+  sqe->opcode    = IORING_OP_WRITE;
+  sqe->fd        = sf->id;
+  sqe->addr      = (uint64_t)(uintptr_t)sf->inflight;
+  sqe->len       = (uint32_t)sf->inflightlen;
+  sqe->off       = (uint64_t)-1; /* The current position. */
+  sqe->user_data = (uint64_t)(uintptr_t)sf;
+  r->sqarray[idx] = idx;
+
+  atomic_store(&sf->busy, true);
+  __atomic_store_n(r->sqtail, tail + 1, __ATOMIC_RELEASE);
+  r->inflight++;
+  (void)atomic_fetch_add(&r->queued, 1);
+
+  return _logmutex_unlock(&r->mutex);
+}
+
+void
+_log_uring_flush(void)
+{
+  logring *r = &_log_ring;
+
+  if (_LOG_URING_RUNNING != atomic_load(&r->state)
+      || 0 == atomic_load_explicit(&r->queued, memory_order_relaxed))
+    {
+      return;
+    }
+
+  if (_logmutex_lock(&r->mutex))
+    {
+      _log_uring_submit(r, 0);
+      (void)_logmutex_unlock(&r->mutex);
+    }
+}
+
+void
+_log_uring_wait(logfile *sf)
+{
+  logring *r = &_log_ring;
+
+  while (atomic_load(&sf->busy) && _logmutex_lock(&r->mutex))
+    {
+      _log_uring_reap(r);
+
+      if (atomic_load(&sf->busy))
+        {
+          _log_uring_submit(r, 1);
+        }
+
+      (void)_logmutex_unlock(&r->mutex);
+    }
+}
+
+bool
+_log_uring_busy(logfile *sf)
+{
+  logring *r = &_log_ring;
+
+  if (atomic_load(&sf->busy) && _logmutex_lock(&r->mutex))
+    {
+      _log_uring_reap(r);
+      (void)_logmutex_unlock(&r->mutex);
+    }
+
+  return atomic_load(&sf->busy);
+}
+
+void
+_log_uring_drain(void)
+{
+  logring *r = &_log_ring;
+
+  if (_LOG_URING_RUNNING == atomic_load(&r->state)
+      && _logmutex_lock(&r->mutex))
+    {
+      while (r->inflight > 0)
+        {
+          _log_uring_submit(r, 1);
+        }
+
+      (void)_logmutex_unlock(&r->mutex);
+    }
+}
+
+void
+_log_uring_submit(logring *r, unsigned wait)
+{
+  for (;;)
+    {
+      unsigned queued = atomic_load(&r->queued);
+      int enter       = (int)syscall(__NR_io_uring_enter, r->fd, queued, wait,
+                                     wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+      if (enter >= 0)
+        {
+          (void)atomic_fetch_sub(&r->queued, (unsigned)enter);
+          break;
+        }
+
+      if (EINTR == errno)
+        {
+          continue;
+        }
+
+      if (EAGAIN == errno || EBUSY == errno)
+        {
+          /* Out of room for completions; make some, then try again. */
+          _log_uring_reap(r);
+          (void)sched_yield();
+          continue;
+        }
+
+      _log_handleerr(errno);
+      _log_uring_cancel(r);
+      break;
+    }
+
+  _log_uring_reap(r);
+}
+
+void
+_log_uring_reap(logring *r)
+{
+  unsigned head = *r->cqhead;
+  unsigned tail = __atomic_load_n(r->cqtail, __ATOMIC_ACQUIRE);
+
+  while (head != tail)
+    {
+      const struct io_uring_cqe *cqe = &r->cqes[head & *r->cqmask];
+
+      _log_uring_complete((logfile *)(uintptr_t)cqe->user_data, cqe->res);
+      r->inflight--;
+      head++;
+    }
+
+  __atomic_store_n(r->cqhead, head, __ATOMIC_RELEASE);
+}
+
+void
+_log_uring_complete(logfile *sf, int res)
+{
+  size_t wrote = res > 0 ? (size_t)res : 0;
+
+  if (res < 0)
+    {
+      _log_handleerr(-res);
+    }
+
+  if (wrote < sf->inflightlen)
+    {
+      /* Short, or failed; like LOGB_FD, what can't be written is discarded. */
+      logiovec vec = {
+        0
+      };
+
+      _log_iovappend(&vec, sf->inflight + wrote, sf->inflightlen - wrote);
+
+      if (!_log_writev(sf->id, &vec))
+        {
+          int err = _log_getoserror();
+
+          _log_selflog(
+            "%s: failed to write %'lu buffered bytes to %d\n",
+            __func__,
+            sf->inflightlen - wrote,
+            sf->id);
+
+          (void)atomic_fetch_add(&sf->lost, sf->inflightmsgs);
+          atomic_store(&sf->failed, 0 != err ? err : EIO);
+        }
+    }
+
+  sf->inflightlen  = 0;
+  sf->inflightmsgs = 0;
+  atomic_store(&sf->busy, false);
+}
+
+void
+_log_uring_cancel(logring *r)
+{
+  unsigned head = __atomic_load_n(r->sqhead, __ATOMIC_ACQUIRE);
+  unsigned tail = *r->sqtail;
+
+  for (unsigned n = head; n != tail; n++)
+    {
+      const struct io_uring_sqe *sqe = &r->sqes[r->sqarray[n & *r->sqmask]];
+
+      _log_uring_complete((logfile *)(uintptr_t)sqe->user_data, 0);
+      r->inflight--;
+    }
+
+  /* The kernel hasn't seen them; take them back. */
+  __atomic_store_n(r->sqtail, head, __ATOMIC_RELEASE);
+  atomic_store(&r->queued, 0);
+}
+
+void
+_log_uring_atfork_prepare(void)
+{
+  logring *r = &_log_ring;
+
+  _log_ring_forklocked = _LOG_URING_RUNNING == atomic_load(&r->state)
+                         && _logmutex_lock(&r->mutex);
+}
+
+void
+_log_uring_atfork_parent(void)
+{
+  if (_log_ring_forklocked)
+    {
+      (void)_logmutex_unlock(&_log_ring.mutex);
+    }
+}
+
+void
+_log_uring_atfork_child(void)
+{
+  logring *r = &_log_ring;
+
+  _log_uring_atfork_parent();
+
+  /* Nothing is in flight (see _log_atfork_prepare); set up again if needed. */
+  if (_LOG_URING_RUNNING == atomic_load(&r->state))
+    {
+      _log_uring_teardown(r);
+      atomic_store(&r->state, _LOG_URING_STOPPED);
+    }
+}
+
+#endif /* ifdef LOG_URING */
@@ -0,0 +1,125 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 240cc516-c9a5-11f1-a265-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _LOG_URING_H_INCLUDED
+# define _LOG_URING_H_INCLUDED
+
+# include "sirtypes.h"
+
+# ifdef LOG_URING
+
+/*
+ * Sets up the io_uring shared by LOGB_URING files, if it isn't already.
+ * Returns false if io_uring isn't available (e.g., the kernel is older than
+ * 5.6, or it's disabled); LOGB_URING files then behave as LOGB_FD files.
+ */
+
+bool _log_uring_start(void);
+
+/* Tears down the io_uring, once no files use it. */
+
+void _log_uring_stop(void);
+
+/* Maps the io_uring's queues into memory. */
+
+bool _log_uring_setup(logring *r);
+
+/* Unmaps the io_uring's queues and closes it. */
+
+void _log_uring_teardown(logring *r);
+
+/*
+ * Queues a write of a LOGB_URING file's inflight buffer (at its end),
+ * without submitting it. Called with the file locked.
+ */
+
+bool _log_uring_write(logfile *sf);
+
+/*
+ * Submits the queued writes, if any, all at once, and reaps completions.
+ * Called after each batch of writes (e.g., a message dispatched to every
+ * file that wants it).
+ */
+
+void _log_uring_flush(void);
+
+/* Waits for a LOGB_URING file's write (if any) to complete. */
+
+void _log_uring_wait(logfile *sf);
+
+/*
+ * Determines whether a LOGB_URING file's write is still in progress, having
+ * handled any completions, without waiting.
+ */
+
+bool _log_uring_busy(logfile *sf);
+
+/* Waits for every write to complete. */
+
+void _log_uring_drain(void);
+
+/*
+ * Submits queued writes, waiting for at least wait of them to complete,
+ * and reaps completions. Called with the io_uring's mutex held.
+ */
+
+void _log_uring_submit(logring *r, unsigned wait);
+
+/* Handles the completions in the completion queue. */
+
+void _log_uring_reap(logring *r);
+
+/*
+ * Finishes a write that completed having written res bytes (or failed with
+ * -res), by writing whatever is left synchronously. If that fails too, the
+ * failure is recorded on the file, for _logfile_uringfault; the file may not
+ * be locked by this thread.
+ */
+
+void _log_uring_complete(logfile *sf, int res);
+
+/*
+ * Writes the queued (not yet submitted) writes synchronously, if they can't
+ * be submitted.
+ */
+
+void _log_uring_cancel(logring *r);
+
+/* Locks the ring before fork, if it is running. */
+
+void _log_uring_atfork_prepare(void);
+
+/* Unlocks the ring after fork, in the parent process. */
+
+void _log_uring_atfork_parent(void);
+
+/* Forgets the parent's io_uring in a child process after fork. */
+
+void _log_uring_atfork_child(void);
+
+# endif /* ifdef LOG_URING */
+
+#endif /* !_LOG_URING_H_INCLUDED */
@@ -0,0 +1,350 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 750bed88-c9a1-11f1-bac1-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "sirworker.h"
+#include "sircompress.h"
+#include "sirconsole.h"
+#include "sirfilecache.h"
+#include "sirinternal.h"
+#include "sirmutex.h"
+#include "sirthread.h"
+
+#ifndef LOG_NO_ASYNC
+
+enum
+{
+  _LOG_WORKER_STOPPED = 0,
+  _LOG_WORKER_STARTING,
+  _LOG_WORKER_RUNNING
+};
+
+static logworker _log_w;
+
+/* Whether _log_worker_atfork_prepare locked the helper's mutex. */
+static bool _log_w_forklocked;
+
+bool
+_log_worker_start(void)
+{
+  logworker *w = &_log_w;
+  int state    = _LOG_WORKER_STOPPED;
+
+  if (!atomic_compare_exchange_strong(&w->state, &state, _LOG_WORKER_STARTING))
+    {
+      /* Another thread got here first; wait for it to finish. */
+      while (_LOG_WORKER_STARTING == state)
+        {
+          (void)sched_yield();
+          state = atomic_load(&w->state);
+        }
+
+      return _LOG_WORKER_RUNNING == state;
+    }
+
+  atomic_init(&w->sleeping, false);
+  atomic_init(&w->stop,     false);
+  w->woken    = false;
+  w->nrolls   = 0;
+  w->reserved = 0;
+  w->renaming = 0;
+
+  if (_logmutex_create(&w->mutex))
+    {
+      if (_logcond_create(&w->cond))
+        {
+          if (_logcond_create(&w->renamed))
+            {
+              if (_logthread_create(&w->thread, _log_worker_thread, w))
+                {
+                  atomic_store(&w->state, _LOG_WORKER_RUNNING);
+                  return true;
+                }
+
+              (void)_logcond_destroy(&w->renamed);
+            }
+
+          (void)_logcond_destroy(&w->cond);
+        }
+
+      (void)_logmutex_destroy(&w->mutex);
+    }
+
+  atomic_store(&w->state, _LOG_WORKER_STOPPED);
+  return false;
+}
+
+bool
+_log_worker_stop(void)
+{
+  logworker *w = &_log_w;
+
+  if (_LOG_WORKER_RUNNING != atomic_load(&w->state))
+    {
+      return true;
+    }
+
+  atomic_store(&w->stop, true);
+  (void)_logmutex_lock(&w->mutex);
+  (void)_logcond_signal(&w->cond);
+  (void)_logmutex_unlock(&w->mutex);
+
+  bool stop = _logthread_join(&w->thread);
+  stop &= _logcond_destroy(&w->renamed);
+  stop &= _logcond_destroy(&w->cond);
+  stop &= _logmutex_destroy(&w->mutex);
+
+  atomic_store(&w->state, _LOG_WORKER_STOPPED);
+  _log_selflog("%s: helper thread stopped\n", __func__);
+  return stop;
+}
+
+void
+_log_worker_wake(void)
+{
+  logworker *w = &_log_w;
+
+  if (_LOG_WORKER_RUNNING == atomic_load(&w->state)
+      && atomic_load(&w->sleeping))
+    {
+      (void)_logmutex_lock(&w->mutex);
+      w->woken = true;
+      (void)_logcond_signal(&w->cond);
+      (void)_logmutex_unlock(&w->mutex);
+    }
+}
+
+bool
+_log_worker_reserveroll(void)
+{
+  logworker *w = &_log_w;
+
+  if (!_log_worker_start())
+    {
+      return false;
+    }
+
+  bool reserved = false;
+
+  (void)_logmutex_lock(&w->mutex);
+
+  if (w->nrolls + w->reserved < LOG_ROLLQUEUE)
+    {
+      w->reserved++;
+      reserved = true;
+    }
+
+  (void)_logmutex_unlock(&w->mutex);
+  return reserved;
+}
+
+void
+_log_worker_cancelroll(void)
+{
+  logworker *w = &_log_w;
+
+  (void)_logmutex_lock(&w->mutex);
+  w->reserved--;
+  (void)_logcond_broadcast(&w->renamed);
+  (void)_logmutex_unlock(&w->mutex);
+}
+
+void
+_log_worker_roll(const logrolljob *job)
+{
+  logworker *w = &_log_w;
+
+  (void)_logmutex_lock(&w->mutex);
+  w->reserved--;
+  w->rolls[w->nrolls++] = *job;
+  w->woken              = true;
+  (void)_logcond_signal(&w->cond);
+  (void)_logmutex_unlock(&w->mutex);
+}
+
+void
+_log_worker_waitrolls(void)
+{
+  logworker *w = &_log_w;
+
+  if (_LOG_WORKER_RUNNING != atomic_load(&w->state))
+    {
+      return;
+    }
+
+  (void)_logmutex_lock(&w->mutex);
+
+  /* Woken by each rename; the timeout only covers the helper exiting. */
+  while (w->nrolls + w->reserved + w->renaming > 0
+         && _LOG_WORKER_RUNNING == atomic_load(&w->state))
+    {
+      (void)_logcond_timedwait(&w->renamed, &w->mutex, LOG_WORKERWAIT);
+    }
+
+  (void)_logmutex_unlock(&w->mutex);
+}
+
+void
+_log_worker_runjobs(logworker *w)
+{
+  for (;;)
+    {
+      logrolljob rolls[LOG_ROLLQUEUE];
+      size_t nrolls = 0;
+
+      (void)_logmutex_lock(&w->mutex);
+
+      nrolls      = w->nrolls;
+      w->renaming = nrolls;
+      w->nrolls   = 0;
+      (void)memcpy(rolls, w->rolls, sizeof ( rolls[0] ) * nrolls);
+
+      (void)_logmutex_unlock(&w->mutex);
+
+      if (0 == nrolls)
+        {
+          break;
+        }
+
+      logchar_t *archives[LOG_ROLLQUEUE] = { 0 };
+
+      /* Oldest first, and all renamed before any are compressed. */
+      for (size_t n = 0; n < nrolls; n++)
+        {
+          if (rolls[n].tmppath && !_log_archiveroll(&rolls[n], &archives[n]))
+            {
+              _log_safefree(archives[n]);
+              archives[n] = NULL;
+            }
+
+          (void)_logmutex_lock(&w->mutex);
+          w->renaming--;
+          (void)_logcond_broadcast(&w->renamed);
+          (void)_logmutex_unlock(&w->mutex);
+        }
+
+      for (size_t n = 0; n < nrolls; n++)
+        {
+          logchar_t *zpath = NULL;
+
+          if (rolls[n].compress && _log_validptr(archives[n])
+              && _log_compressfile(archives[n], &zpath))
+            {
+              _log_safefree(archives[n]);
+              archives[n] = zpath;
+            }
+
+          /* Then the oldest archives are pruned, if need be. */
+          if (!rolls[n].tmppath || _log_validptr(archives[n]))
+            {
+              _log_fcache_archived(rolls[n].path, archives[n]);
+            }
+
+          _log_safefree(archives[n]);
+          _log_safefree(rolls[n].path);
+          _log_safefree(rolls[n].tmppath);
+        }
+    }
+}
+
+void *
+_log_worker_thread(void *arg)
+{
+  logworker *w = (logworker *)arg;
+
+  (void)_log_setthreadname("sirworker");
+
+  while (!atomic_load(&w->stop))
+    {
+      /* Announce the intent to sleep before looking for work. */
+      atomic_store(&w->sleeping, true);
+
+      uint32_t wait    = _log_fcache_tick();
+      uint32_t conwait = _log_console_tick();
+
+      if (conwait < wait)
+        {
+          wait = conwait;
+        }
+
+      _log_worker_runjobs(w);
+
+      (void)_logmutex_lock(&w->mutex);
+
+      if (!w->woken && !atomic_load(&w->stop))
+        {
+          (void)_logcond_timedwait(&w->cond, &w->mutex, wait);
+        }
+
+      w->woken = false;
+      atomic_store(&w->sleeping, false);
+      (void)_logmutex_unlock(&w->mutex);
+    }
+
+  /* Finish what was queued before being asked to stop. */
+  _log_worker_runjobs(w);
+  return NULL;
+}
+
+void
+_log_worker_atfork_prepare(void)
+{
+  _log_w_forklocked = _LOG_WORKER_RUNNING == atomic_load(&_log_w.state)
+                      && _logmutex_lock(&_log_w.mutex);
+}
+
+void
+_log_worker_atfork_parent(void)
+{
+  if (_log_w_forklocked)
+    {
+      (void)_logmutex_unlock(&_log_w.mutex);
+    }
+}
+
+void
+_log_worker_atfork_child(void)
+{
+  _log_worker_atfork_parent();
+
+  /*
+   * The thread does not exist in the child; it is started again if needed,
+   * which creates its mutex and condition variable anew.
+   */
+  atomic_store(&_log_w.state, _LOG_WORKER_STOPPED);
+
+  /* The parent archives what it rolled. */
+  for (size_t n = 0; n < _log_w.nrolls; n++)
+    {
+      _log_safefree(_log_w.rolls[n].path);
+      _log_safefree(_log_w.rolls[n].tmppath);
+    }
+
+  _log_w.nrolls   = 0;
+  _log_w.reserved = 0;
+  _log_w.renaming = 0;
+}
+
+#endif /* ifndef LOG_NO_ASYNC */
@@ -0,0 +1,105 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * scspell-id: 75011f66-c9a1-11f1-a62b-02fc00000001
+ *
+ * Copyright (c) 2018 Ryan M. Lederman
+ * Copyright (c) 2022 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _LOG_WORKER_H_INCLUDED
+# define _LOG_WORKER_H_INCLUDED
+
+# include "sirtypes.h"
+
+# ifndef LOG_NO_ASYNC
+
+/*
+ * Starts the background helper thread, if it is not already running. Safe to
+ * call from any thread at any time after log_init.
+ */
+
+bool _log_worker_start(void);
+
+/* Stops the background helper thread and waits for it to exit. */
+
+bool _log_worker_stop(void);
+
+/*
+ * Wakes the background helper thread if it is waiting with nothing
+ * scheduled, so that it picks up newly scheduled work.
+ */
+
+void _log_worker_wake(void);
+
+/*
+ * Reserves room to queue a rolled file for the background helper thread,
+ * starting it if necessary. Returns false if the queue is full. Each
+ * reservation is followed by _log_worker_roll or _log_worker_cancelroll.
+ */
+
+bool _log_worker_reserveroll(void);
+
+/* Releases room reserved by _log_worker_reserveroll, unused. */
+
+void _log_worker_cancelroll(void);
+
+/*
+ * Queues a rolled file to be archived (and compressed, if requested) by the
+ * background helper thread, in room reserved by _log_worker_reserveroll.
+ * The helper thread takes ownership of the job's strings.
+ */
+
+void _log_worker_roll(const logrolljob *job);
+
+/*
+ * Waits until the background helper thread has renamed every rolled file
+ * queued so far (not necessarily compressed them), sleeping until each is.
+ * Must not be called with the file cache section or any file locked.
+ */
+
+void _log_worker_waitrolls(void);
+
+/*
+ * Archives (and compresses) the queued rolled files, and prunes archives
+ * according to each file's retention policy.
+ */
+
+void _log_worker_runjobs(logworker *w);
+
+/* The background helper thread. */
+
+void *_log_worker_thread(void *arg);
+
+/* Locks the background helper thread's queue before fork, if it's running. */
+
+void _log_worker_atfork_prepare(void);
+
+/* Unlocks the background helper thread's queue after fork, in the parent. */
+
+void _log_worker_atfork_parent(void);
+
+/* Forgets the background helper thread in a child process after fork. */
+
+void _log_worker_atfork_child(void);
+
+# endif /* ifndef LOG_NO_ASYNC */
+
+#endif /* !_LOG_WORKER_H_INCLUDED */
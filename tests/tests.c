@@ -46,6 +46,20 @@ static const log_test log_tests[] = {
   { "error handling sanity",   logtest_errorsanity           },
   { "text style sanity",       logtest_textstylesanity       },
   { "update levels/options",   logtest_updatesanity          },
+  { "asynchronous mode",       logtest_asyncsanity           },
+  { "thread name",             logtest_threadname            },
+  { "file flush policies",     logtest_fileflush             },
+  { "log file backends",       logtest_filebackend           },
+  { "log file roll policies",  logtest_fileroll              },
+  { "compress archives",       logtest_filecompress          },
+  { "archive retention",       logtest_fileretain            },
+  { "durable messages",        logtest_filesync              },
+  { "failing log files",       logtest_filefault             },
+  { "preallocated log files",  logtest_fileprealloc          },
+  { "redirected console",      logtest_consoleredirect       },
+  { "time stamps",             logtest_timestamps            },
+  { "elided fields",           logtest_fieldelision          },
+  { "fork while logging",      logtest_forksafety            },
 };
 
 static const char *arg_wait
@@ -266,8 +280,17 @@ logtest_failnooutputdest(void)
       pass &= log_info("this goes to stdout");
       pass &= log_stdoutlevels(LOGL_NONE);
 
-      pass &= NULL != log_addfile(logfile, LOGL_INFO, LOGO_DEFAULT);
+      logfileid_t id = log_addfile(logfile, LOGL_INFO, LOGO_DEFAULT);
+      pass &= NULL != id;
       pass &= log_info("this goes to %s", logfile);
+      pass &= !log_debug("this goes nowhere!");
+
+      pass &= log_filelevels(id, LOGL_DEBUG);
+      pass &= log_debug("this goes to %s", logfile);
+      pass &= !log_info("this goes nowhere!");
+
+      pass &= log_remfile(id);
+      pass &= !log_debug("this goes nowhere!");
 
       rmfile(logfile);
     }
@@ -495,6 +518,9 @@ logtest_rollandarchivefile(void)
         }
       while (written < deltasize + ( linesize * 50 ));
 
+      /* Waits for the file to be archived. */
+      pass &= log_flush();
+
       /* Look for files matching the original name. */
       unsigned foundlogs = 0;
       if (!enumfiles(logfilename, countfiles, &foundlogs))
@@ -633,6 +659,32 @@ logtest_textstylesanity(void)
   return printerror(pass);
 }
 
+/* Counts evaluations of arguments that should have been elided. */
+
+static const char *
+logtest_elidedarg(size_t *evaluated)
+{
+  ( *evaluated )++;
+  return "lorem ipsum foo bar blah";
+}
+
+/* Debug-level calls compiled against a minimum level of LOGL_INFO. */
+
+#undef LOG_COMPILE_MIN_LEVEL
+#define LOG_COMPILE_MIN_LEVEL LOGL_INFO
+
+static void
+logtest_elided(size_t lines, size_t *evaluated)
+{
+  for (size_t n = 0; n < lines; n++)
+    {
+      (void)log_debug("%s", logtest_elidedarg(evaluated));
+    }
+}
+
+#undef LOG_COMPILE_MIN_LEVEL
+#define LOG_COMPILE_MIN_LEVEL LOGL_DEBUG
+
 bool
 logtest_perf(void)
 {
@@ -647,6 +699,15 @@ logtest_perf(void)
       float printfelapsed = 0.0f;
       float stdioelapsed  = 0.0f;
       float fileelapsed   = 0.0f;
+      float fdelapsed     = 0.0f;
+      float mmapelapsed   = 0.0f;
+      float directelapsed = 0.0f;
+      float allocelapsed[2] = { 0.0f, 0.0f };
+      float multielapsed[2] = { 0.0f, 0.0f };
+      float asyncelapsed  = 0.0f;
+      float rejectelapsed = 0.0f;
+      float elideelapsed  = 0.0f;
+      size_t evaluated    = 0;
 
       printf("\t%'lu lines printf...\n", perflines);
 
@@ -681,6 +742,30 @@ logtest_perf(void)
       INIT(si2, 0, 0, 0, 0);
       pass &= si2_init;
 
+      printf("\t%'lu lines rejected at runtime...\n", perflines);
+
+      logtimer_t rejecttimer = { 0 };
+      startlogtimer(&rejecttimer);
+
+      for (size_t n = 0; n < perflines; n++)
+        {
+          log_debug("%s", logtest_elidedarg(&evaluated));
+        }
+
+      rejectelapsed = logtimerelapsed(&rejecttimer);
+      pass         &= perflines == evaluated;
+
+      printf("\t%'lu lines elided at compile time...\n", perflines);
+
+      evaluated = 0;
+      logtimer_t elidetimer = { 0 };
+      startlogtimer(&elidetimer);
+
+      logtest_elided(perflines, &evaluated);
+
+      elideelapsed = logtimerelapsed(&elidetimer);
+      pass        &= 0 == evaluated;
+
       logfileid_t logid  = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY);
       pass              &= NULL != logid;
 
@@ -701,6 +786,169 @@ logtest_perf(void)
           pass &= log_remfile(logid);
         }
 
+#ifndef _WIN32
+      logid  = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY);
+      pass  &= NULL != logid;
+
+      if (pass)
+        {
+          pass &= log_filebackend(logid, LOGB_FD, 0);
+          pass &= log_fileflush(logid, 0, 0, LOGL_NONE);
+
+          printf("\t%'lu lines log file (raw fd)...\n", perflines);
+
+          logtimer_t fdtimer = { 0 };
+          startlogtimer(&fdtimer);
+
+          for (size_t n = 0; n < perflines; n++)
+            {
+              log_debug("lorem ipsum foo bar blah");
+            }
+
+          pass     &= log_flush();
+          fdelapsed = logtimerelapsed(&fdtimer);
+
+          pass &= log_remfile(logid);
+        }
+
+      logid  = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY);
+      pass  &= NULL != logid;
+
+      if (pass)
+        {
+          pass &= log_filebackend(logid, LOGB_MMAP, 0);
+
+          printf("\t%'lu lines log file (mmap)...\n", perflines);
+
+          logtimer_t mmaptimer = { 0 };
+          startlogtimer(&mmaptimer);
+
+          for (size_t n = 0; n < perflines; n++)
+            {
+              log_debug("lorem ipsum foo bar blah");
+            }
+
+          mmapelapsed = logtimerelapsed(&mmaptimer);
+
+          pass &= log_remfile(logid);
+        }
+
+      logid  = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY);
+      pass  &= NULL != logid;
+
+      if (pass)
+        {
+          /* The default policy: buffered, without growing the page cache. */
+          pass &= log_filebackend(logid, LOGB_DIRECT, 0);
+
+          printf("\t%'lu lines log file (O_DIRECT)...\n", perflines);
+
+          logtimer_t directtimer = { 0 };
+          startlogtimer(&directtimer);
+
+          for (size_t n = 0; n < perflines; n++)
+            {
+              log_debug("lorem ipsum foo bar blah");
+            }
+
+          pass         &= log_flush();
+          directelapsed = logtimerelapsed(&directtimer);
+
+          pass &= log_remfile(logid);
+        }
+
+      /* Unbuffered, each line extends the file, unless it's preallocated. */
+      for (size_t p = 0; p < 2 && pass; p++)
+        {
+          logid  = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY);
+          pass  &= NULL != logid;
+          pass  &= pass && log_filebackend(logid, LOGB_FD, 0);
+          pass  &= pass && log_filepreallocate(logid, 1 == p);
+
+          if (pass)
+            {
+              printf("\t%'lu lines log file (unbuffered raw fd%s)...\n",
+                     perflines, 1 == p ? ", preallocated" : "");
+
+              logtimer_t alloctimer = { 0 };
+              startlogtimer(&alloctimer);
+
+              for (size_t n = 0; n < perflines; n++)
+                {
+                  log_debug("lorem ipsum foo bar blah");
+                }
+
+              allocelapsed[p] = logtimerelapsed(&alloctimer);
+
+              pass &= log_remfile(logid);
+            }
+        }
+
+      /* Four unbuffered files: a write to each per line, or one submission. */
+      const log_backend multi[2] = { LOGB_FD, LOGB_URING };
+
+      for (size_t b = 0; b < 2 && pass; b++)
+        {
+          logfileid_t ids[4] = { NULL };
+
+          for (size_t n = 0; n < 4; n++)
+            {
+              char path[LOG_MAXPATH] = { 0 };
+              (void)snprintf(path, LOG_MAXPATH, "%s.%lu", logfilename, n);
+
+              ids[n]  = log_addfile(path, LOGL_ALL, LOGO_MSGONLY);
+              pass   &= NULL != ids[n] && log_filebackend(ids[n], multi[b], 0);
+            }
+
+          printf("\t%'lu lines to 4 log files (%s)...\n", perflines,
+                 LOGB_FD == multi[b] ? "raw fd" : "io_uring");
+
+          logtimer_t multitimer = { 0 };
+          startlogtimer(&multitimer);
+
+          for (size_t n = 0; n < perflines; n++)
+            {
+              log_debug("lorem ipsum foo bar blah");
+            }
+
+          pass           &= log_flush();
+          multielapsed[b] = logtimerelapsed(&multitimer);
+
+          for (size_t n = 0; n < 4; n++)
+            {
+              pass &= log_remfile(ids[n]);
+            }
+        }
+#endif /* ifndef _WIN32 */
+
+      log_cleanup();
+
+      loginit si3 = { 0 };
+      si3.async   = true;
+      pass       &= log_init(&si3);
+
+      logid  = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY);
+      pass  &= NULL != logid;
+
+      if (pass)
+        {
+          printf("\t%'lu lines log file (async)...\n", perflines);
+
+          logtimer_t asynctimer = { 0 };
+          startlogtimer(&asynctimer);
+
+          for (size_t n = 0; n < perflines; n++)
+            {
+              log_debug("lorem ipsum foo bar blah");
+            }
+
+          asyncelapsed = logtimerelapsed(&asynctimer);
+
+          /* Write the remaining queued messages before removing the file. */
+          pass &= log_flush();
+          pass &= log_remfile(logid);
+        }
+
       if (pass)
         {
           printf("\t" WHITE("%'lu lines printf   :")
@@ -715,6 +963,48 @@ logtest_perf(void)
                  " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
             perflines,    fileelapsed / 1e3,
             perflines / ( fileelapsed / 1e3 ));
+#ifndef _WIN32
+          printf("\t" WHITE("%'lu lines raw fd   :")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    fdelapsed / 1e3,
+            perflines / ( fdelapsed / 1e3 ));
+          printf("\t" WHITE("%'lu lines mmap     :")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    mmapelapsed / 1e3,
+            perflines / ( mmapelapsed / 1e3 ));
+          printf("\t" WHITE("%'lu lines fd write :")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    allocelapsed[0] / 1e3,
+            perflines / ( allocelapsed[0] / 1e3 ));
+          printf("\t" WHITE("%'lu lines fallocate:")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    allocelapsed[1] / 1e3,
+            perflines / ( allocelapsed[1] / 1e3 ));
+          printf("\t" WHITE("%'lu lines O_DIRECT :")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    directelapsed / 1e3,
+            perflines / ( directelapsed / 1e3 ));
+          printf("\t" WHITE("%'lu lines 4x raw fd:")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    multielapsed[0] / 1e3,
+            perflines / ( multielapsed[0] / 1e3 ));
+          printf("\t" WHITE("%'lu lines 4x uring :")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    multielapsed[1] / 1e3,
+            perflines / ( multielapsed[1] / 1e3 ));
+#endif /* ifndef _WIN32 */
+          printf("\t" WHITE("%'lu lines async    :")
+                 " "  GREEN("%'.2fsec (%'.1f lines/sec)") "\n",
+            perflines,    asyncelapsed / 1e3,
+            perflines / ( asyncelapsed / 1e3 ));
+          printf("\t" WHITE("%'lu lines rejected :")
+                 " "  GREEN("%'.4fsec (%'.2fns/line)") "\n",
+            perflines,    rejectelapsed / 1e3,
+            ( rejectelapsed * 1e6 ) / perflines);
+          printf("\t" WHITE("%'lu lines elided   :")
+                 " "  GREEN("%'.4fsec (%'.2fns/line)") "\n",
+            perflines,    elideelapsed / 1e3,
+            ( elideelapsed * 1e6 ) / perflines);
         }
     }
 
@@ -941,101 +1231,1297 @@ logtest_thread(void *arg)
 #endif /* ifndef _WIN32 */
 }
 
+#ifndef _WIN32
+static void *logtest_asyncthread(void *arg);
+#else  /* ifndef _WIN32 */
+static unsigned logtest_asyncthread(void *arg);
+#endif /* ifndef _WIN32 */
+
+#define ASYNC_THREADS 4
+#define ASYNC_LINES   2500
+
 bool
-printerror(bool pass)
+logtest_asyncsanity(void)
 {
-  if (!pass)
+#ifndef _WIN32
+  pthread_t thrds[ASYNC_THREADS];
+#else  /* ifndef _WIN32 */
+  uintptr_t thrds[ASYNC_THREADS];
+#endif /* ifndef _WIN32 */
+
+  const char *logfile = "async.log";
+
+  rmfile(logfile);
+
+  loginit si = { 0 };
+  si.async   = true;
+  bool pass  = log_init(&si);
+
+  pass &= NULL != log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+
+  if (pass)
     {
-      logchar_t message[LOG_MAXERROR] = {
-        0
-      };
-      uint16_t code = log_geterror(message);
-      printf("\t" RED("!! Unexpected (%hu, %s)") "\n", code, message);
+      for (size_t n = 0; n < ASYNC_THREADS; n++)
+        {
+#ifndef _WIN32
+          int create = pthread_create(&thrds[n], NULL, logtest_asyncthread, NULL);
+          if (0 != create)
+            {
+              errno = create;
+#else  /* ifndef _WIN32 */
+          thrds[n] = _beginthreadex(NULL, 0, logtest_asyncthread, NULL, 0, NULL);
+          if (0 == thrds[n])
+            {
+#endif /* ifndef _WIN32 */
+              printf(RED("\tfailed to create thread; err: %d") "\n", errno);
+              pass = false;
+            }
+        }
+
+      for (size_t n = 0; n < ASYNC_THREADS; n++)
+        {
+#ifndef _WIN32
+          pthread_join(thrds[n], NULL);
+#else  /* ifndef _WIN32 */
+          WaitForSingleObject((HANDLE)thrds[n], INFINITE);
+#endif /* ifndef _WIN32 */
+        }
     }
 
-  return pass;
-}
+  /* Queued messages must all be written by the time cleanup returns. */
+  pass &= log_cleanup();
 
-void
-printexpectederr(void)
-{
-  logchar_t message[LOG_MAXERROR] = {
-    0
-  };
-  uint16_t code = log_geterror(message);
+  size_t lines = countlines(logfile);
 
-  printf("\t" GREEN("Expected (%hu, %s") "\n", code, message);
+  printf("\t%'lu/%'lu lines written\n", lines,
+         (size_t)( ASYNC_THREADS * ASYNC_LINES ));
+  pass &= lines == ASYNC_THREADS * ASYNC_LINES;
+
+  rmfile(logfile);
+  return printerror(pass);
 }
 
-int
-getoserr(void)
-{
 #ifndef _WIN32
-  return errno;
+static void *
+logtest_asyncthread(void *arg)
+{
 #else  /* ifndef _WIN32 */
-  return (int)GetLastError();
+unsigned
+logtest_asyncthread(void *arg)
+{
 #endif /* ifndef _WIN32 */
-}
+  (void)arg;
 
-unsigned int
-getrand(void)
-{
-  static unsigned int seed = 0;
+  for (size_t n = 0; n < ASYNC_LINES; n++)
+    {
+      (void)log_info("async message %lu", n);
+    }
 
 #ifndef _WIN32
-  return (unsigned int)rand_r(&seed);
+  return NULL;
 #else  /* ifndef _WIN32 */
-  if (0 == rand_s(&seed))
-    {
-      return seed;
-    }
-  else
-    {
-      srand(seed);
-      return (unsigned int)rand();
-    }
+  return 0;
 #endif /* ifndef _WIN32 */
 }
 
-bool
-rmfile(const char *filename)
-{
 #ifndef _WIN32
-  return 0 == remove(filename);
+static void *logtest_namedthread(void *arg);
 #else  /* ifndef _WIN32 */
-  return FALSE != DeleteFile(filename);
+static unsigned logtest_namedthread(void *arg);
 #endif /* ifndef _WIN32 */
-}
 
 bool
-deletefiles(const char *search, const char *filename, unsigned *data)
+logtest_threadname(void)
 {
-  if (strstr(filename, search))
+  const char *logfile = "threadname.log";
+
+  rmfile(logfile);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  pass &= NULL != log_addfile(logfile, LOGL_ALL, LOGO_NOTIME | LOGO_NOHDR);
+
+  if (pass)
     {
-      struct stat st;
-      if (0 == stat(filename, &st))
+      bool logged = false;
+
+#ifndef _WIN32
+      pthread_t thrd;
+      int create = pthread_create(&thrd, NULL, logtest_namedthread, &logged);
+      if (0 != create)
         {
-          printf("\tdeleting %s (size: %'lu)...\n", filename, st.st_size);
+          errno = create;
+#else  /* ifndef _WIN32 */
+      uintptr_t thrd = _beginthreadex(NULL, 0, logtest_namedthread, &logged, 0, NULL);
+      if (0 == thrd)
+        {
+#endif /* ifndef _WIN32 */
+          printf(RED("\tfailed to create thread; err: %d") "\n", errno);
+          pass = false;
         }
-
-      if (!rmfile(filename))
+      else
         {
-          fprintf(
-            stderr,
-            "\tfailed to delete %s! error: %d\n",
-            filename,
-            getoserr());
+#ifndef _WIN32
+          pthread_join(thrd, NULL);
+#else  /* ifndef _WIN32 */
+          WaitForSingleObject((HANDLE)thrd, INFINITE);
+#endif /* ifndef _WIN32 */
         }
 
-      ( *data )++;
+      pass &= logged;
     }
 
-  return true;
+  log_cleanup();
+
+  pass &= filecontains(logfile, LOG_PIDSEPARATOR "sir-named");
+
+  rmfile(logfile);
+  return printerror(pass);
 }
 
-bool
-countfiles(const char *search, const char *filename, unsigned *data)
-{
+#ifndef _WIN32
+static void *
+logtest_namedthread(void *arg)
+{
+#else  /* ifndef _WIN32 */
+unsigned
+logtest_namedthread(void *arg)
+{
+#endif /* ifndef _WIN32 */
+  bool *logged = (bool *)arg;
+
+  *logged  = log_info("before naming");
+  *logged &= log_setthreadname("sir-named");
+  *logged &= log_info("after naming");
+
+#ifndef _WIN32
+  return NULL;
+#else  /* ifndef _WIN32 */
+  return 0;
+#endif /* ifndef _WIN32 */
+}
+
+bool
+logtest_fileflush(void)
+{
+  const char *logfile = "flush.log";
+
+  rmfile(logfile);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  logfileid_t id = log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  if (pass)
+    {
+      /* Only errors (and log_flush) write anything. */
+      pass &= log_fileflush(id, 0, 0, LOGL_ERROR);
+      pass &= log_info("buffered 1");
+      pass &= log_info("buffered 2");
+      pass &= 0 == countlines(logfile);
+
+      pass &= log_error("written with the two before it");
+      pass &= 3 == countlines(logfile);
+
+      pass &= log_debug("buffered 3");
+      pass &= 3 == countlines(logfile);
+      pass &= log_flush();
+      pass &= 4 == countlines(logfile);
+
+      /* Every other message. */
+      pass &= log_fileflush(id, 2, 0, LOGL_NONE);
+      pass &= log_info("buffered 4");
+      pass &= 4 == countlines(logfile);
+      pass &= log_info("written with the one before it");
+      pass &= 6 == countlines(logfile);
+
+#ifndef LOG_NO_ASYNC
+      /* Written by the helper thread after 50ms. */
+      pass &= log_fileflush(id, 0, 50, LOGL_NONE);
+      pass &= log_info("buffered 5");
+      pass &= 6 == countlines(logfile);
+
+      for (size_t n = 0; n < 100 && 7 != countlines(logfile); n++)
+        {
+          (void)usleep(10000);
+        }
+
+      pass &= 7 == countlines(logfile);
+#endif /* ifndef LOG_NO_ASYNC */
+
+      /* Back to unbuffered. */
+      pass &= log_fileflush(id, 1, 0, LOGL_NONE);
+      pass &= log_info("unbuffered");
+      pass &= filecontains(logfile, "unbuffered");
+    }
+
+  pass &= log_cleanup();
+  rmfile(logfile);
+  return printerror(pass);
+}
+
+bool
+logtest_filebackend(void)
+{
+  const char *logfile = "backend.log";
+
+  rmfile(logfile);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  logfileid_t id = log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+#ifndef _WIN32
+  if (pass)
+    {
+      pass &= !log_filebackend(id, LOGB_FD, LOG_FBUFMAX + 1);
+      printexpectederr();
+
+      /* Buffers are written out only when full, by log_flush, or at fork. */
+      pass &= log_filebackend(id, LOGB_FD, 128);
+      pass &= log_fileflush(id, 0, 0, LOGL_NONE);
+      pass &= log_info("buffered 1");
+      pass &= log_info("buffered 2");
+      pass &= 0 == countlines(logfile);
+
+      pid_t pid = fork();
+
+      if (0 == pid)
+        {
+          (void)log_info("from the child");
+          (void)log_flush();
+          _exit(0);
+        }
+
+      pass &= -1 != pid && pid == waitpid(pid, NULL, 0);
+      pass &= 3 == countlines(logfile);
+      pass &= filecontains(logfile, "from the child");
+
+      size_t lines = 3;
+
+      for (size_t n = 0; n < 16; n++)
+        {
+          pass &= log_info("line %lu of sixteen", n);
+        }
+
+      /* Each time the buffer filled, whole lines were written. */
+      pass &= countlines(logfile) > lines;
+      pass &= log_flush();
+      pass &= lines + 16 == countlines(logfile);
+
+      char big[256] = { 0 };
+      (void)memset(big, 'x', sizeof ( big ) - 1);
+      pass &= log_info("%s", big);
+      pass &= lines + 17 == countlines(logfile);
+
+      /* Switching backends writes out the buffer first. */
+      pass &= log_info("buffered 3");
+      pass &= log_filebackend(id, LOGB_STDIO, 0);
+      pass &= lines + 18 == countlines(logfile);
+      pass &= log_fileflush(id, 1, 0, LOGL_NONE);
+      pass &= log_info("unbuffered");
+      pass &= lines + 19 == countlines(logfile);
+
+      /* Through io_uring (or as LOGB_FD), filling each buffer in turn. */
+      pass &= log_filebackend(id, LOGB_URING, 64);
+
+      for (size_t n = 0; n < 8; n++)
+        {
+          pass &= log_info("io_uring line %lu of eight", n);
+        }
+
+      pass &= log_flush();
+      pass &= lines + 27 == countlines(logfile);
+      pass &= filecontains(logfile, "io_uring line 7 of eight");
+
+      /* Direct files are written in whole blocks, but never left padded. */
+      struct stat st = { 0 };
+      off_t written  = 0;
+
+      pass &= 0 == stat(logfile, &st);
+      written = st.st_size;
+
+      pass &= log_filebackend(id, LOGB_DIRECT, 0);
+      pass &= log_fileflush(id, 0, 0, LOGL_NONE);
+
+      for (size_t n = 0; n < 200; n++)
+        {
+          char line[LOG_MAXMESSAGE] = { 0 };
+          int len = snprintf(line, LOG_MAXMESSAGE, "direct line %lu", n);
+
+          pass    &= log_info("%s", line);
+          written += len + 1;
+        }
+
+      pass &= log_flush();
+      pass &= lines + 227 == countlines(logfile);
+      pass &= 0 == stat(logfile, &st) && st.st_size == written;
+
+      /* The partial block is written again, with what follows it. */
+      pass    &= log_info("direct again");
+      pass    &= log_flush();
+      written += (off_t)strlen("direct again\n");
+      pass    &= lines + 228 == countlines(logfile);
+      pass    &= 0 == stat(logfile, &st) && st.st_size == written;
+      pass    &= filecontains(logfile, "direct line 199");
+
+      /* Mapped files are preallocated, and truncated when closed. */
+      pass &= log_filebackend(id, LOGB_MMAP, 0);
+      pass &= log_info("mapped");
+      pass &= lines + 229 == countlines(logfile);
+      pass &= filecontains(logfile, "mapped");
+      pass &= 0 == stat(logfile, &st) && st.st_size >= LOG_FROLLSIZE;
+
+      pass    &= log_remfile(id);
+      written += (off_t)strlen("mapped\n");
+      pass    &= 0 == stat(logfile, &st) && st.st_size == written;
+
+      /* Until log_flush, only whole blocks are written, whatever the policy. */
+      const char *directfile = "direct.log";
+      rmfile(directfile);
+
+      logfileid_t direct = log_addfile(directfile, LOGL_ALL,
+                                       LOGO_MSGONLY | LOGO_NOHDR);
+      pass &= NULL != direct;
+      pass &= log_filebackend(direct, LOGB_DIRECT, 0);
+
+      for (size_t n = 0; n < 20 && pass; n++)
+        {
+          if (10 == n)
+            {
+              pass &= log_fileflush(direct, 1, 0, LOGL_NONE);
+            }
+
+          pass &= log_info("direct tail %lu", n);
+        }
+
+      pass &= 0 == stat(directfile, &st) && 0 == st.st_size;
+      pass &= log_flush();
+      pass &= 20 == countlines(directfile);
+      pass &= log_remfile(direct);
+      rmfile(directfile);
+    }
+#else  /* ifndef _WIN32 */
+  pass &= !log_filebackend(id, LOGB_FD, 0);
+  printexpectederr();
+  pass &= !log_filebackend(id, LOGB_MMAP, 0);
+  printexpectederr();
+  pass &= !log_filebackend(id, LOGB_URING, 0);
+  printexpectederr();
+  pass &= !log_filebackend(id, LOGB_DIRECT, 0);
+  printexpectederr();
+#endif /* ifndef _WIN32 */
+
+  pass &= log_cleanup();
+  rmfile(logfile);
+  return printerror(pass);
+}
+
+bool
+logtest_fileroll(void)
+{
+  const logchar_t *const logfilename = "rollpolicy";
+  const logchar_t *const line        = "hello, i am some data. nice to meet you.";
+
+  unsigned found = 0;
+  (void)enumfiles(logfilename, deletefiles, &found);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  logfileid_t id = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  if (pass)
+    {
+      /* Rolled every five to seven lines. */
+      pass &= log_fileroll(id, 256, 0);
+
+      for (size_t n = 0; n < 20; n++)
+        {
+          pass &= log_info("%s", line);
+        }
+
+      /* Waits for the files to be archived; no replacements are left. */
+      unsigned tmpfiles = 0;
+
+      pass &= log_flush();
+
+      found = 0;
+      pass &= enumfiles(logfilename, countfiles, &found);
+      pass &= enumfiles(".tmp", countfiles, &tmpfiles);
+      pass &= 4 == found && 0 == tmpfiles;
+
+      /* No size limit; rolled each second. */
+      unsigned rolled = 0;
+
+      pass &= log_fileroll(id, 0, 1);
+
+      found = 0;
+      pass &= enumfiles(logfilename, countfiles, &found);
+
+#ifndef _WIN32
+      struct timespec ts = {
+        1, 100000000
+      };
+      (void)nanosleep(&ts, NULL);
+#else  /* ifndef _WIN32 */
+      Sleep(1100);
+#endif /* ifndef _WIN32 */
+
+      pass &= log_info("%s", line);
+      pass &= log_flush();
+      pass &= enumfiles(logfilename, countfiles, &rolled);
+      pass &= found + 1 == rolled;
+
+      pass &= log_remfile(id);
+    }
+
+  pass &= log_cleanup();
+
+  found = 0;
+  (void)enumfiles(logfilename, deletefiles, &found);
+  return printerror(pass);
+}
+
+static const logchar_t *const logtest_lz4line
+  = "hello, i am some data. nice to meet you.";
+
+/* Counts the logged lines in an archive (decompressed) or the log file. */
+
+static bool logtest_lz4lines(const char *search, const char *filename,
+                             unsigned *data);
+
+bool
+logtest_filecompress(void)
+{
+  const logchar_t *const logfilename = "lz4test";
+  const logchar_t *const line        = logtest_lz4line;
+
+  unsigned found = 0;
+  (void)enumfiles(logfilename, deletefiles, &found);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  logfileid_t id = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  if (pass)
+    {
+      /* Three archives, as in the roll policy test. */
+      pass &= log_fileroll(id, 256, 0);
+      pass &= log_filecompress(id, true);
+
+      for (size_t n = 0; n < 20; n++)
+        {
+          pass &= log_info("%s", line);
+        }
+    }
+
+  /* Waits for the archives to be compressed. */
+  pass &= log_cleanup();
+
+  unsigned compressed = 0;
+
+  found = 0;
+  pass &= enumfiles(logfilename, countfiles, &found);
+  pass &= enumfiles(LOG_FCOMPRESSEXT, countfiles, &compressed);
+  pass &= 4 == found && 3 == compressed;
+
+  /* Together with what's left in the log file, they hold every line. */
+  unsigned lines = 0;
+  pass &= enumfiles(logfilename, logtest_lz4lines, &lines);
+  pass &= 20 == lines;
+
+  found = 0;
+  (void)enumfiles(logfilename, deletefiles, &found);
+  return printerror(pass);
+}
+
+static bool
+logtest_lz4lines(const char *search, const char *filename, unsigned *data)
+{
+  if (!strstr(filename, search))
+    {
+      return true;
+    }
+
+  char text[4096] = { 0 };
+  size_t len      = 0;
+  bool valid      = false;
+
+  if (strstr(filename, LOG_FCOMPRESSEXT))
+    {
+      valid = lz4decompress(filename, text, sizeof ( text ) - 1, &len);
+    }
+  else
+    {
+      FILE *f = fopen(filename, "rb");
+
+      if (f)
+        {
+          len   = fread(text, 1, sizeof ( text ) - 1, f);
+          valid = feof(f);
+          fclose(f);
+        }
+    }
+
+  valid &= len > 0 && '\n' == text[len - 1];
+
+  /* Besides the logged lines, only the file's header (and blank lines). */
+  for (char *line = text; valid && line < text + len;)
+    {
+      char *eol = strchr(line, '\n');
+      *eol      = '\0';
+
+      if (0 == strcmp(line, logtest_lz4line))
+        {
+          ( *data )++;
+        }
+      else
+        {
+          valid = '\0' == *line || NULL != strstr(line, LOG_FHBEGIN);
+        }
+
+      line = eol + 1;
+    }
+
+  if (!valid)
+    {
+      fprintf(stderr, "\t%s doesn't hold the lines that were logged\n", filename);
+      *data = 0;
+    }
+
+  return valid;
+}
+
+bool
+logtest_fileretain(void)
+{
+  const logchar_t *const logfilename = "retaintest";
+  const logchar_t *const line        = "hello, i am some data. nice to meet you.";
+
+  unsigned found = 0;
+  (void)enumfiles(logfilename, deletefiles, &found);
+
+  /* Left by an earlier run, and older than any archive rolled below. */
+  const logchar_t *const earlier[] = {
+    "retaintest-1999-12-31-235958-001",
+    "retaintest-1999-12-31-235959-002.lz4",
+    "retaintest-1999-12-31-235959-003",
+  };
+
+  for (size_t n = 0; n < sizeof ( earlier ) / sizeof ( earlier[0] ); n++)
+    {
+      FILE *f = fopen(earlier[n], "w");
+
+      if (f)
+        {
+          (void)fputs(line, f);
+          (void)fclose(f);
+        }
+    }
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  logfileid_t id = log_addfile(logfilename, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  if (pass)
+    {
+      /* Finds and prunes the earlier archives; then three more are rolled. */
+      pass &= log_fileretain(id, 2, 0, 0);
+      pass &= log_fileroll(id, 256, 0);
+
+      for (size_t n = 0; n < 20; n++)
+        {
+          pass &= log_info("%s", line);
+        }
+    }
+
+  /* Waits for the archives to be pruned. */
+  pass &= log_cleanup();
+
+  found = 0;
+  pass &= enumfiles(logfilename, countfiles, &found);
+  pass &= 3 == found;
+
+  for (size_t n = 0; n < sizeof ( earlier ) / sizeof ( earlier[0] ); n++)
+    {
+      pass &= 0 != access(earlier[n], F_OK);
+    }
+
+  found = 0;
+  (void)enumfiles(logfilename, deletefiles, &found);
+  return printerror(pass);
+}
+
+#ifndef _WIN32
+static void *logtest_syncthread(void *arg);
+#else  /* ifndef _WIN32 */
+static unsigned logtest_syncthread(void *arg);
+#endif /* ifndef _WIN32 */
+
+#define SYNC_LINES 50
+
+bool
+logtest_filesync(void)
+{
+#ifndef _WIN32
+  pthread_t thrds[ASYNC_THREADS];
+#else  /* ifndef _WIN32 */
+  uintptr_t thrds[ASYNC_THREADS];
+#endif /* ifndef _WIN32 */
+
+  const char *logfile = "sync.log";
+
+  rmfile(logfile);
+
+  loginit si = { 0 };
+  si.async   = true;
+  bool pass  = log_init(&si);
+
+  logfileid_t id = log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  if (pass)
+    {
+      /* Nothing is written until a critical message, which writes it all. */
+      pass &= log_fileflush(id, 0, 0, LOGL_NONE);
+      pass &= log_filesync(id, LOGL_CRIT);
+      pass &= log_info("queued or buffered 1");
+      pass &= log_error("queued or buffered 2");
+      pass &= log_crit("synced with the two before it");
+      pass &= 3 == countlines(logfile);
+
+      pass &= log_warn("buffered 3");
+      pass &= log_alert("synced with the one before it");
+      pass &= 5 == countlines(logfile);
+
+      /* Only a single level and LOGL_NONE make sense. */
+      pass &= !log_filesync(id, LOGL_CRIT | LOGL_ERROR);
+      printexpectederr();
+
+      /* Threads waiting on each other's syncs. */
+      for (size_t n = 0; n < ASYNC_THREADS; n++)
+        {
+#ifndef _WIN32
+          int create = pthread_create(&thrds[n], NULL, logtest_syncthread, NULL);
+          if (0 != create)
+            {
+              errno = create;
+#else  /* ifndef _WIN32 */
+          thrds[n] = _beginthreadex(NULL, 0, logtest_syncthread, NULL, 0, NULL);
+          if (0 == thrds[n])
+            {
+#endif /* ifndef _WIN32 */
+              printf(RED("\tfailed to create thread; err: %d") "\n", errno);
+              pass = false;
+            }
+        }
+
+      for (size_t n = 0; n < ASYNC_THREADS; n++)
+        {
+#ifndef _WIN32
+          pthread_join(thrds[n], NULL);
+#else  /* ifndef _WIN32 */
+          WaitForSingleObject((HANDLE)thrds[n], INFINITE);
+#endif /* ifndef _WIN32 */
+        }
+
+      pass &= 5 + ASYNC_THREADS * SYNC_LINES == countlines(logfile);
+
+      pass &= log_filesync(id, LOGL_NONE);
+      pass &= log_emerg("buffered 4");
+      pass &= 5 + ASYNC_THREADS * SYNC_LINES == countlines(logfile);
+    }
+
+  pass &= log_cleanup();
+  rmfile(logfile);
+  return printerror(pass);
+}
+
+#ifndef _WIN32
+static void *
+logtest_syncthread(void *arg)
+{
+#else  /* ifndef _WIN32 */
+unsigned
+logtest_syncthread(void *arg)
+{
+#endif /* ifndef _WIN32 */
+  (void)arg;
+
+  for (size_t n = 0; n < SYNC_LINES; n++)
+    {
+      (void)log_crit("synced message %lu", n);
+    }
+
+#ifndef _WIN32
+  return NULL;
+#else  /* ifndef _WIN32 */
+  return 0;
+#endif /* ifndef _WIN32 */
+}
+
+bool
+logtest_filefault(void)
+{
+  const char *logfile = "fault.log";
+
+  rmfile(logfile);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+#ifndef _WIN32
+  logfileid_t id = log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  struct rlimit limit = { 0 };
+  pass &= 0 == getrlimit(RLIMIT_FSIZE, &limit);
+
+  /* Writes past the limit fail (EFBIG), rather than raise SIGXFSZ. */
+  void (*xfsz)(int) = signal(SIGXFSZ, SIG_IGN);
+
+  if (pass)
+    {
+      struct rlimit low = limit;
+      low.rlim_cur      = 1024;
+
+      pass &= log_filebackend(id, LOGB_FD, 0);
+      pass &= 0 == setrlimit(RLIMIT_FSIZE, &low);
+
+      /* The write that fails, and those after it, are dropped. */
+      size_t written = 0;
+
+      while (written < 100 && log_info("filling line %lu", written))
+        {
+          written++;
+        }
+
+      pass &= written < 100;
+
+      for (size_t n = 0; n < 10; n++)
+        {
+          pass &= !log_info("dropped line %lu", n);
+        }
+
+      pass &= !filecontains(logfile, "dropped line");
+      pass &= 0 == setrlimit(RLIMIT_FSIZE, &limit);
+
+      /* Writing is tried again once LOG_FRETRYMIN has passed. */
+      (void)usleep(LOG_FRETRYMIN * 2 * 1000);
+
+      pass &= log_info("resumed");
+      pass &= filecontains(logfile, "11 message(s) dropped");
+      pass &= filecontains(logfile, "resumed");
+
+      /* Likewise when the write that fails completes later (io_uring). */
+      struct stat st = { 0 };
+      pass        &= 0 == stat(logfile, &st);
+      low.rlim_cur = (rlim_t)st.st_size + 1024;
+
+      pass &= log_filebackend(id, LOGB_URING, 64);
+      pass &= 0 == setrlimit(RLIMIT_FSIZE, &low);
+
+      written = 0;
+
+      while (written < 100 && log_info("queued line %lu", written))
+        {
+          written++;
+        }
+
+      pass &= written < 100;
+      pass &= 0 == setrlimit(RLIMIT_FSIZE, &limit);
+
+      /* A write still in flight may fail too, putting off the retry. */
+      bool resumed = false;
+
+      for (size_t n = 0; n < 20 && !resumed; n++)
+        {
+          (void)usleep(LOG_FRETRYMIN * 2 * 1000);
+          resumed = log_info("resumed again");
+        }
+
+      pass &= resumed;
+      pass &= log_flush();
+      pass &= filecontains(logfile, "resumed again");
+    }
+
+  (void)setrlimit(RLIMIT_FSIZE, &limit);
+  (void)signal(SIGXFSZ, xfsz);
+#endif /* ifndef _WIN32 */
+
+  pass &= log_cleanup();
+  rmfile(logfile);
+  return printerror(pass);
+}
+
+bool
+logtest_fileprealloc(void)
+{
+  const char *logfile = "prealloc.log";
+
+  rmfile(logfile);
+
+  INIT(si, 0, 0, 0, 0);
+  bool pass = si_init;
+
+  logfileid_t id = log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+  pass &= NULL != id;
+
+  if (pass)
+    {
+      struct stat st = { 0 };
+      off_t written  = 0;
+
+      pass &= log_fileroll(id, 65536, 0);
+      pass &= log_filepreallocate(id, true);
+
+      for (size_t n = 0; n < 10; n++)
+        {
+          char line[LOG_MAXMESSAGE] = { 0 };
+          int len = snprintf(line, LOG_MAXMESSAGE, "preallocated line %lu", n);
+
+          pass    &= log_info("%s", line);
+          written += len + 1;
+        }
+
+      /* The file's size is what was written, not what was allocated. */
+      pass &= 0 == stat(logfile, &st) && st.st_size == written;
+#ifdef LOG_FALLOCATE
+      pass &= st.st_blocks * 512 >= 65536;
+#endif /* ifdef LOG_FALLOCATE */
+
+      /* What's left over is released. */
+      pass &= log_filepreallocate(id, false);
+      pass &= 0 == stat(logfile, &st) && st.st_size == written;
+      pass &= st.st_blocks * 512 < 65536;
+      pass &= 10 == countlines(logfile);
+    }
+
+  pass &= log_cleanup();
+  rmfile(logfile);
+  return printerror(pass);
+}
+
+bool
+logtest_consoleredirect(void)
+{
+  const char *logfile = "console.log";
+  const char *errfile = "console.err";
+  bool pass           = true;
+  bool init           = false;
+
+  rmfile(logfile);
+  rmfile(errfile);
+
+#ifndef _WIN32
+  /* stdout and stderr are redirected to files before libsir looks at them. */
+  (void)fflush(stdout);
+  (void)fflush(stderr);
+  int saved    = dup(STDOUT_FILENO);
+  int savederr = dup(STDERR_FILENO);
+  int fd       = open(logfile, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  int errfd    = open(errfile, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+  pass &= -1 != saved && -1 != fd && -1 != dup2(fd, STDOUT_FILENO);
+  pass &= -1 != savederr && -1 != errfd && -1 != dup2(errfd, STDERR_FILENO);
+
+  if (pass)
+    {
+      INIT(si, LOGL_ALL, LOGO_NOTIME | LOGO_NOPID, LOGL_ERROR,
+           LOGO_NOTIME | LOGO_NOPID);
+      pass &= si_init;
+      init  = si_init;
+
+      for (size_t n = 0; n < 10; n++)
+        {
+          pass &= log_info("redirected line %lu", n);
+        }
+
+      /* Errors aren't left in the buffer, in case the process aborts. */
+      pass &= log_error("redirected error");
+      pass &= filecontains(errfile, "redirected error");
+    }
+
+  /* Before log_cleanup, whose self-log lines (if any) go to stderr. */
+  (void)fflush(stderr);
+
+  if (-1 != savederr)
+    {
+      (void)dup2(savederr, STDERR_FILENO);
+      (void)close(savederr);
+    }
+
+  if (init)
+    {
+      pass &= log_flush();
+      pass &= log_cleanup();
+    }
+
+  (void)fflush(stdout);
+
+  if (-1 != saved)
+    {
+      (void)dup2(saved, STDOUT_FILENO);
+      (void)close(saved);
+    }
+
+  if (-1 != fd)
+    {
+      (void)close(fd);
+    }
+
+  if (-1 != errfd)
+    {
+      (void)close(errfd);
+    }
+
+  /* Every line arrives, without styling sequences. */
+  pass &= 11 == countlines(logfile);
+  pass &= filecontains(logfile, "redirected line 9");
+  pass &= !filecontains(logfile, "\x1b[");
+  pass &= filecontains(errfile, "redirected error");
+  pass &= !filecontains(errfile, "\x1b[");
+#endif /* ifndef _WIN32 */
+
+  rmfile(logfile);
+  rmfile(errfile);
+  return printerror(pass);
+}
+
+bool
+logtest_timestamps(void)
+{
+  bool pass  = true;
+  time_t now = time(NULL);
+
+  logchar_t first[LOG_MAXTIME]  = { 0 };
+  logchar_t second[LOG_MAXTIME] = { 0 };
+  logchar_t direct[LOG_MAXTIME] = { 0 };
+  size_t len                    = 0;
+
+  /* The cached stamp is replaced when the second changes. */
+  pass &= _log_formattimestamp(now, first, &len);
+  pass &= len == strlen(first);
+  pass &= _log_formattimestamp(now + 1, second, NULL);
+  pass &= 0 != strcmp(first, second);
+  pass &= _log_formattime(now + 1, direct, LOG_TIMEFORMAT);
+  pass &= 0 == strcmp(second, direct);
+  pass &= _log_formattimestamp(now, second, NULL);
+  pass &= 0 == strcmp(first, second);
+
+  /* Milliseconds are always three digits. */
+  const long long msecs[] = { 0, 7, 42, 999 };
+  const char *expected[]  = { "000", "007", "042", "999" };
+
+  for (size_t n = 0; n < 4; n++)
+    {
+      logchar_t msec[LOG_MAXMSEC] = { 0 };
+
+      _log_formatmsec(msecs[n], msec);
+      pass &= LOG_MSECSEPARATOR == msec[0];
+      pass &= 0 == strcmp(msec + 1, expected[n]);
+    }
+
+  return printerror(pass);
+}
+
+#define ELIDE_LINES 1000
+
+bool
+logtest_fieldelision(void)
+{
+  const char *logfile = "elide.log";
+  const char *outfile = "elide.out";
+  bool pass           = true;
+
+  rmfile(logfile);
+  rmfile(outfile);
+
+#ifndef _WIN32
+  (void)fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int fd    = open(outfile, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+  pass &= -1 != saved && -1 != fd && -1 != dup2(fd, STDOUT_FILENO);
+
+  if (pass)
+    {
+      /* Neither destination wants any fields, at first. */
+      loginit si             = { 0 };
+      si.d_stdout.levels     = LOGL_ALL;
+      si.d_stdout.opts       = LOGO_MSGONLY;
+      si.async               = true;
+      pass                  &= log_init(&si);
+
+      logfileid_t id = log_addfile(logfile, LOGL_ALL, LOGO_MSGONLY | LOGO_NOHDR);
+      pass &= NULL != id;
+
+      pass &= log_info("elided fields");
+      pass &= log_flush();
+
+      /*
+       * Messages queued before stdout wants a time stamp and level are
+       * written without them, rather than with empty ones.
+       */
+      for (size_t n = 0; n < ELIDE_LINES; n++)
+        {
+          if (ELIDE_LINES / 2 == n)
+            {
+              pass &= log_stdoutopts(LOGO_NONAME | LOGO_NOPID | LOGO_NOTID);
+            }
+
+          pass &= log_info("elided fields");
+        }
+
+      pass &= log_cleanup();
+    }
+
+  (void)fflush(stdout);
+
+  if (-1 != saved)
+    {
+      (void)dup2(saved, STDOUT_FILENO);
+      (void)close(saved);
+    }
+
+  if (-1 != fd)
+    {
+      (void)close(fd);
+    }
+
+  pass &= ELIDE_LINES + 1 == countlines(logfile);
+  pass &= ELIDE_LINES + 1 == countlines(outfile);
+
+  FILE *f = fopen(logfile, "r");
+
+  if (f)
+    {
+      char line[LOG_MAXOUTPUT] = { 0 };
+
+      while (NULL != fgets(line, LOG_MAXOUTPUT, f))
+        {
+          pass &= 0 == strcmp(line, "elided fields\n");
+        }
+
+      fclose(f);
+    }
+
+  f = fopen(outfile, "r");
+
+  if (f)
+    {
+      char line[LOG_MAXOUTPUT] = { 0 };
+      bool stamped             = false;
+
+      while (NULL != fgets(line, LOG_MAXOUTPUT, f))
+        {
+          stamped = NULL != strstr(line, "[INFO]: elided fields\n")
+                    && line[0] >= '0' && line[0] <= '9';
+
+          pass &= stamped || 0 == strcmp(line, "elided fields\n");
+        }
+
+      /* The last line was logged after the options changed. */
+      pass &= stamped;
+
+      fclose(f);
+    }
+  else
+    {
+      pass = false;
+    }
+#endif /* ifndef _WIN32 */
+
+  rmfile(logfile);
+  rmfile(outfile);
+  return printerror(pass);
+}
+
+#ifndef _WIN32
+static void *logtest_forkthread(void *arg);
+
+# define FORK_CHILDREN 100
+
+static atomic_bool logtest_forkstop;
+#endif /* ifndef _WIN32 */
+
+bool
+logtest_forksafety(void)
+{
+  const char *logfile = "fork.log";
+  bool pass           = true;
+
+#ifndef _WIN32
+  for (int async = 0; async < 2 && pass; async++)
+    {
+      rmfile(logfile);
+
+      loginit si = { 0 };
+      si.async   = 1 == async;
+      pass      &= log_init(&si);
+      pass      &= NULL != log_addfile(logfile, LOGL_ALL, LOGO_NOHDR);
+
+      pthread_t thrd;
+      atomic_store(&logtest_forkstop, false);
+
+      int create = pthread_create(&thrd, NULL, logtest_forkthread, NULL);
+      pass &= 0 == create;
+
+      /* A child that inherits a lock held by the other thread hangs. */
+      for (size_t n = 0; n < FORK_CHILDREN && pass; n++)
+        {
+          pid_t child = fork();
+
+          if (0 == child)
+            {
+              (void)alarm(10);
+              _exit(log_crit("logged by child %d", (int)getpid()) ? 0 : 1);
+            }
+
+          int status = 0;
+          pass &= -1 != child && child == waitpid(child, &status, 0);
+          pass &= WIFEXITED(status) && 0 == WEXITSTATUS(status);
+        }
+
+      atomic_store(&logtest_forkstop, true);
+
+      if (0 == create)
+        {
+          (void)pthread_join(thrd, NULL);
+        }
+
+      pass &= log_cleanup();
+      printf("	%s: %lu line(s) written\n", async ? "async" : "sync",
+             countlines(logfile));
+    }
+
+  rmfile(logfile);
+#endif /* ifndef _WIN32 */
+
+  return printerror(pass);
+}
+
+#ifndef _WIN32
+static void *
+logtest_forkthread(void *arg)
+{
+  (void)arg;
+
+  while (!atomic_load(&logtest_forkstop))
+    {
+      (void)log_info("logged by parent's thread");
+    }
+
+  return NULL;
+}
+#endif /* ifndef _WIN32 */
+
+bool
+printerror(bool pass)
+{
+  if (!pass)
+    {
+      logchar_t message[LOG_MAXERROR] = {
+        0
+      };
+      uint16_t code = log_geterror(message);
+      printf("\t" RED("!! Unexpected (%hu, %s)") "\n", code, message);
+    }
+
+  return pass;
+}
+
+void
+printexpectederr(void)
+{
+  logchar_t message[LOG_MAXERROR] = {
+    0
+  };
+  uint16_t code = log_geterror(message);
+
+  printf("\t" GREEN("Expected (%hu, %s") "\n", code, message);
+}
+
+int
+getoserr(void)
+{
+#ifndef _WIN32
+  return errno;
+#else  /* ifndef _WIN32 */
+  return (int)GetLastError();
+#endif /* ifndef _WIN32 */
+}
+
+unsigned int
+getrand(void)
+{
+  static unsigned int seed = 0;
+
+#ifndef _WIN32
+  return (unsigned int)rand_r(&seed);
+#else  /* ifndef _WIN32 */
+  if (0 == rand_s(&seed))
+    {
+      return seed;
+    }
+  else
+    {
+      srand(seed);
+      return (unsigned int)rand();
+    }
+#endif /* ifndef _WIN32 */
+}
+
+bool
+rmfile(const char *filename)
+{
+#ifndef _WIN32
+  return 0 == remove(filename);
+#else  /* ifndef _WIN32 */
+  return FALSE != DeleteFile(filename);
+#endif /* ifndef _WIN32 */
+}
+
+bool
+deletefiles(const char *search, const char *filename, unsigned *data)
+{
+  if (strstr(filename, search))
+    {
+      struct stat st;
+      if (0 == stat(filename, &st))
+        {
+          printf("\tdeleting %s (size: %'lu)...\n", filename, st.st_size);
+        }
+
+      if (!rmfile(filename))
+        {
+          fprintf(
+            stderr,
+            "\tfailed to delete %s! error: %d\n",
+            filename,
+            getoserr());
+        }
+
+      ( *data )++;
+    }
+
+  return true;
+}
+
+bool
+countfiles(const char *search, const char *filename, unsigned *data)
+{
   if (strstr(filename, search))
     {
       ( *data )++;
@@ -1101,6 +2587,189 @@ enumfiles(const char *search, fileenumproc cb, unsigned *data)
   return true;
 }
 
+size_t
+countlines(const char *filename)
+{
+  size_t lines = 0;
+  FILE *f      = fopen(filename, "r");
+
+  if (f)
+    {
+      int c;
+
+      while (EOF != ( c = fgetc(f)))
+        {
+          if ('\n' == c)
+            {
+              lines++;
+            }
+        }
+
+      fclose(f);
+    }
+
+  return lines;
+}
+
+bool
+filecontains(const char *filename, const char *search)
+{
+  bool found = false;
+  FILE *f    = fopen(filename, "r");
+
+  if (f)
+    {
+      char line[LOG_MAXOUTPUT] = {
+        0
+      };
+
+      while (!found && NULL != fgets(line, LOG_MAXOUTPUT, f))
+        {
+          found = NULL != strstr(line, search);
+        }
+
+      fclose(f);
+    }
+
+  return found;
+}
+
+static uint32_t
+lz4read32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+         | (uint32_t)p[3] << 24;
+}
+
+static size_t
+lz4readlen(const uint8_t **ip, const uint8_t *end, size_t len)
+{
+  if (15 == len)
+    {
+      uint8_t b;
+
+      do
+        {
+          if (*ip >= end)
+            {
+              return SIZE_MAX;
+            }
+
+          b    = *( *ip )++;
+          len += b;
+        }
+      while (255 == b);
+    }
+
+  return len;
+}
+
+bool
+lz4decompress(const char *filename, char *out, size_t size, size_t *len)
+{
+  uint8_t frame[8192] = { 0 };
+  FILE *f             = fopen(filename, "rb");
+
+  if (!f)
+    {
+      return false;
+    }
+
+  size_t read = fread(frame, 1, sizeof ( frame ), f);
+  bool whole  = feof(f);
+  fclose(f);
+
+  /* Magic number, FLG, BD and the header checksum, as the writer sets them. */
+  if (!whole || read < 7 || 0x184d2204U != lz4read32(frame)
+      || 0x60 != frame[4] || 0x40 != frame[5]
+      || frame[6] != (uint8_t)( _log_xxh32(frame + 4, 2, 0) >> 8 ))
+    {
+      return false;
+    }
+
+  const uint8_t *ip  = frame + 7;
+  const uint8_t *end = frame + read;
+  size_t op          = 0;
+
+  while (ip + 4 <= end)
+    {
+      uint32_t blocksize = lz4read32(ip);
+      ip += 4;
+
+      if (0 == blocksize)
+        {
+          /* The end mark; nothing may follow it. */
+          *len = op;
+          return ip == end;
+        }
+
+      size_t blen         = blocksize & 0x7fffffffU;
+      const uint8_t *bend = ip + blen;
+      size_t bstart       = op;
+
+      if (blen > (size_t)( end - ip ))
+        {
+          return false;
+        }
+
+      if (blocksize & 0x80000000U)
+        {
+          if (blen > size - op)
+            {
+              return false;
+            }
+
+          (void)memcpy(out + op, ip, blen);
+          op += blen;
+          ip  = bend;
+          continue;
+        }
+
+      while (ip < bend)
+        {
+          uint8_t token = *ip++;
+          size_t lits   = lz4readlen(&ip, bend, token >> 4);
+
+          if (SIZE_MAX == lits || lits > (size_t)( bend - ip ) || lits > size - op)
+            {
+              return false;
+            }
+
+          (void)memcpy(out + op, ip, lits);
+          op += lits;
+          ip += lits;
+
+          if (ip == bend)
+            {
+              break; /* The last sequence has no match. */
+            }
+
+          if (2 > bend - ip)
+            {
+              return false;
+            }
+
+          size_t off   = (size_t)ip[0] | (size_t)ip[1] << 8;
+          ip          += 2;
+          size_t mlen  = lz4readlen(&ip, bend, token & 15);
+
+          /* Blocks are independent; matches stay within this one. */
+          if (SIZE_MAX == mlen || 0 == off || off > op - bstart
+              || mlen + 4 > size - op)
+            {
+              return false;
+            }
+
+          for (size_t n = 0; n < mlen + 4; n++, op++)
+            {
+              out[op] = out[op - off];
+            }
+        }
+    }
+
+  return false;
+}
+
 bool
 startlogtimer(logtimer_t *timer)
 {
@@ -1121,7 +2790,7 @@ logtimerelapsed(const logtimer_t *timer)
   if (!clock_gettime(CLOCK_MONOTONIC, &now))
     {
       return (float)(( now.tv_sec * 1e3 ) + ( now.tv_nsec / 1e6 )
-                     - ( timer->ts.tv_sec * 1e3 ) + ( timer->ts.tv_nsec / 1e6 ));
+                     - ( timer->ts.tv_sec * 1e3 ) - ( timer->ts.tv_nsec / 1e6 ));
     }
 
   return 0;
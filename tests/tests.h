@@ -39,7 +39,11 @@
 
 # define _CRT_RAND_S
 
+/* Nothing is elided, except where the performance test overrides this. */
+# define LOG_COMPILE_MIN_LEVEL LOGL_DEBUG
+
 # include "../sir.h"
+# include "../sircompress.h"
 # include "../sirerrors.h"
 # include "../sirfilecache.h"
 # include "../sirinternal.h"
@@ -57,7 +61,10 @@
 # ifndef _WIN32
 #  include <dirent.h>
 #  include <pthread.h>
+#  include <signal.h>
+#  include <sys/resource.h>
 #  include <sys/stat.h>
+#  include <sys/wait.h>
 #  include <unistd.h>
 # else  /* ifndef _WIN32 */
 #  define _WIN32_WINNT 0x0600
@@ -219,6 +226,91 @@ bool logtest_perf(void);
 
 bool logtest_updatesanity(void);
 
+/*
+ * Properly write every queued message in asynchronous mode.
+ */
+
+bool logtest_asyncsanity(void);
+
+/*
+ * Properly include names set by log_setthreadname in output.
+ */
+
+bool logtest_threadname(void);
+
+/*
+ * Properly write buffered output according to each flush policy.
+ */
+
+bool logtest_fileflush(void);
+
+/*
+ * Properly buffer and write output with each log file backend.
+ */
+
+bool logtest_filebackend(void);
+
+/*
+ * Properly roll log files by size and at intervals.
+ */
+
+bool logtest_fileroll(void);
+
+/*
+ * Properly compress archives in the background.
+ */
+
+bool logtest_filecompress(void);
+
+/*
+ * Properly prune archives according to a retention policy.
+ */
+
+bool logtest_fileretain(void);
+
+/*
+ * Properly sync messages of critical levels before returning, in groups.
+ */
+
+bool logtest_filesync(void);
+
+/*
+ * Properly stop writing to a log file that fails, and resume later.
+ */
+
+bool logtest_filefault(void);
+
+/*
+ * Properly preallocate log files without changing their size.
+ */
+
+bool logtest_fileprealloc(void);
+
+/*
+ * Properly write console output redirected to a file, without styling.
+ */
+
+bool logtest_consoleredirect(void);
+
+/*
+ * Properly cache time stamps per second, and pad milliseconds.
+ */
+
+bool logtest_timestamps(void);
+
+/*
+ * Properly render only the fields destinations want, even if their options
+ * change while messages are queued.
+ */
+
+bool logtest_fieldelision(void);
+
+/*
+ * Properly log from a child process forked while another thread logs.
+ */
+
+bool logtest_forksafety(void);
+
 /*
  * bool logtest_xxxx(void);
  */
@@ -238,6 +330,16 @@ typedef bool (*fileenumproc) (const char *search, const char *filename,
 
 bool enumfiles(const char *search, fileenumproc cb, unsigned *data);
 
+size_t countlines(const char *filename);
+bool filecontains(const char *filename, const char *search);
+
+/*
+ * Decompresses an LZ4 frame (as written by log_filecompress) into out, of
+ * size bytes; its length is stored in len. Fails if the frame is invalid.
+ */
+
+bool lz4decompress(const char *filename, char *out, size_t size, size_t *len);
+
 typedef struct
 {
 # ifndef _WIN32